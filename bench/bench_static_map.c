@@ -0,0 +1,392 @@
+#include "static_map.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Benchmark for the static map.
+ * Every result is printed as one CSV row on stdout so runs from different builds can be diffed
+ * or loaded into a spreadsheet. Usage: bench_static_map [log2 map length] [churn rounds]
+ */
+
+#define DEFAULT_LOG2_LENGTH 16
+#define DEFAULT_CHURN_ROUNDS 10
+#define CHURN_CHECKPOINTS 10
+#define BENCH_BATCH_SIZE 64
+
+typedef enum {
+    KEYS_SEQUENTIAL,  // 0, 1, 2, ...
+    KEYS_STRIDED,     // 0, 16, 32, ...
+    KEYS_RANDOM,      // Unique pseudo random keys
+    KEYS_ADVERSARIAL, // Multiples of the map length, these collide under key % length
+    KEYS_NUM,
+} keyDist_t;
+
+static const char *key_dist_names[KEYS_NUM] = {"sequential", "strided", "random", "adversarial"};
+
+typedef struct {
+    const char       *name;
+    staticMapProbe_t  probe;
+    bool              ctrl;
+    bool              strided; // No items pointer array
+} scheme_t;
+
+static const scheme_t schemes[] = {
+    {"linear",             STATIC_MAP_PROBE_LINEAR,     false, false},
+    {"robin_hood",         STATIC_MAP_PROBE_ROBIN_HOOD, false, false},
+    {"linear_ctrl",        STATIC_MAP_PROBE_LINEAR,     true,  false},
+    {"robin_hood_ctrl",    STATIC_MAP_PROBE_ROBIN_HOOD, true,  false},
+    {"linear_strided",     STATIC_MAP_PROBE_LINEAR,     false, true},
+    {"robin_hood_strided", STATIC_MAP_PROBE_ROBIN_HOOD, false, true},
+    {"cuckoo",             STATIC_MAP_PROBE_CUCKOO,     false, false},
+};
+
+#define NUM_SCHEMES (sizeof(schemes) / sizeof(schemes[0]))
+
+static const double load_factors[] = {0.5, 0.75, 0.9};
+static const size_t item_sizes[] = {sizeof(staticMapItem_t) + 8, 64, 256};
+
+#define NUM_LOAD_FACTORS (sizeof(load_factors) / sizeof(load_factors[0]))
+#define NUM_ITEM_SIZES   (sizeof(item_sizes) / sizeof(item_sizes[0]))
+
+typedef struct {
+    staticMap_t       map;
+    staticMapItem_t **array;
+    uint8_t          *storage;
+    uint8_t          *ctrl;
+    size_t            length;
+    size_t            item_size;
+} benchMap_t;
+
+static uint64_t *latencies = NULL;
+static uint32_t *keys = NULL;
+static staticMapItem_t **bulk_out = NULL;
+static uint32_t *bulk_scratch = NULL;
+static staticMapItem_t *batch_out[BENCH_BATCH_SIZE];
+static uint64_t timer_overhead = 0;
+static volatile uint64_t sink = 0;
+
+static inline uint64_t nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void calibrateTimer(void) {
+    timer_overhead = UINT64_MAX;
+    for (int i = 0; i < 10000; i++) {
+        uint64_t start = nowNs();
+        uint64_t delta = nowNs() - start;
+        if (delta < timer_overhead) {
+            timer_overhead = delta;
+        }
+    }
+}
+
+// The n:th key of a distribution, keys are unique for every n
+static uint32_t makeKey(keyDist_t dist, uint32_t n, size_t length) {
+    switch (dist) {
+        case KEYS_SEQUENTIAL:
+            return n;
+        case KEYS_STRIDED:
+            return n * 16;
+        case KEYS_RANDOM:
+            // The murmur finalizer is a bijection, so this never repeats
+            return staticMapHashMix32(n, 0x5bd1e995);
+        case KEYS_ADVERSARIAL:
+        default: {
+            // Rotate so the low bits stay zero for as long as possible while keys remain unique
+            uint32_t shift = (uint32_t)__builtin_ctzll(length);
+            return (n << shift) | (n >> (32 - shift));
+        }
+    }
+}
+
+static int benchMapInit(benchMap_t *bench, const scheme_t *scheme, size_t length, size_t item_size) {
+    staticMapConfig_t config = {.probe = scheme->probe, .ctrl = scheme->ctrl ? bench->ctrl : NULL};
+    if (scheme->strided) {
+        return staticMapInitStrided(&bench->map, length, item_size, (staticMapItem_t *)bench->storage, 0, &config);
+    }
+    return staticMapInitWithConfig(&bench->map, bench->array, length, item_size, (staticMapItem_t *)bench->storage, &config);
+}
+
+static int compareU64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void printHeader(void) {
+    printf("bench,scheme,keys,item_size,length,load,ops,ns_per_op,p50_ns,p99_ns,p999_ns,max_probe,avg_probe,tombstones\n");
+}
+
+static void printRow(const char *bench_name, const scheme_t *scheme, keyDist_t dist, benchMap_t *bench,
+                     double load, size_t ops, uint64_t total_ns, bool with_latency) {
+    uint64_t p50 = 0, p99 = 0, p999 = 0;
+    if (with_latency && ops > 0) {
+        qsort(latencies, ops, sizeof(latencies[0]), compareU64);
+        p50  = latencies[ops / 2];
+        p99  = latencies[(ops * 99) / 100];
+        p999 = latencies[(ops * 999) / 1000];
+    }
+
+    staticMapStats_t stats;
+    staticMapGetStats(&bench->map, &stats);
+
+    printf("%s,%s,%s,%zu,%zu,%.2f,%zu,%.2f,%llu,%llu,%llu,%u,%.3f,%zu\n",
+           bench_name, scheme->name, key_dist_names[dist], bench->item_size, bench->length, load, ops,
+           ops ? (double)total_ns / (double)ops : 0.0,
+           (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)p999,
+           stats.max_probe_distance, stats.avg_probe_distance, stats.tombstones);
+}
+
+static inline uint64_t timedSince(uint64_t start) {
+    uint64_t delta = nowNs() - start;
+    return delta > timer_overhead ? delta - timer_overhead : 0;
+}
+
+static int32_t sumCb(staticMap_t *map, staticMapItem_t *item) {
+    (void)map;
+    sink += item->key;
+    return STATIC_MAP_CB_NEXT;
+}
+
+static int runLoadBench(benchMap_t *bench, const scheme_t *scheme, keyDist_t dist, double load) {
+    size_t n = (size_t)((double)bench->length * load);
+    uint64_t start, total;
+
+    // Keys [0, n) go into the map, keys [n, 2n) are used for misses
+    for (uint32_t i = 0; i < 2 * n; i++) {
+        keys[i] = makeKey(dist, i, bench->length);
+    }
+
+    // Insert throughput, then rebuild with per operation timing
+    if (benchMapInit(bench, scheme, bench->length, bench->item_size) != STATIC_MAP_SUCCESS) {
+        return 1;
+    }
+    start = nowNs();
+    for (uint32_t i = 0; i < n; i++) {
+        if (staticMapInsertAndGet(&bench->map, keys[i]) == NULL) {
+            return 1;
+        }
+    }
+    uint64_t insert_total = nowNs() - start;
+
+    // The same keys in one bulk build
+    benchMapInit(bench, scheme, bench->length, bench->item_size);
+    start = nowNs();
+    if (staticMapBuildFrom(&bench->map, keys, n, bulk_out, bulk_scratch) != (int32_t)n) {
+        return 1;
+    }
+    total = nowNs() - start;
+    printRow("build", scheme, dist, bench, load, n, total, false);
+
+    benchMapInit(bench, scheme, bench->length, bench->item_size);
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t key = keys[i];
+        start = nowNs();
+        staticMapInsertAndGet(&bench->map, key);
+        latencies[i] = timedSince(start);
+    }
+    printRow("insert", scheme, dist, bench, load, n, insert_total, true);
+
+    // Lookups of keys that are in the map
+    start = nowNs();
+    for (uint32_t i = 0; i < n; i++) {
+        sink += (uintptr_t)staticMapFind(&bench->map, keys[i]);
+    }
+    total = nowNs() - start;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t key = keys[i];
+        start = nowNs();
+        sink += (uintptr_t)staticMapFind(&bench->map, key);
+        latencies[i] = timedSince(start);
+    }
+    printRow("find_hit", scheme, dist, bench, load, n, total, true);
+
+    // The same lookups through the batch call
+    start = nowNs();
+    for (size_t i = 0; i < n; i += BENCH_BATCH_SIZE) {
+        size_t batch = (n - i < BENCH_BATCH_SIZE) ? n - i : BENCH_BATCH_SIZE;
+        staticMapFindBatch(&bench->map, &keys[i], batch, batch_out);
+        sink += (uintptr_t)batch_out[0];
+    }
+    total = nowNs() - start;
+    printRow("find_hit_batch", scheme, dist, bench, load, n, total, false);
+
+    // Lookups of keys that are not in the map
+    start = nowNs();
+    for (uint32_t i = 0; i < n; i++) {
+        sink += (uintptr_t)staticMapFind(&bench->map, keys[n + i]);
+    }
+    total = nowNs() - start;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t key = keys[n + i];
+        start = nowNs();
+        sink += (uintptr_t)staticMapFind(&bench->map, key);
+        latencies[i] = timedSince(start);
+    }
+    printRow("find_miss", scheme, dist, bench, load, n, total, true);
+
+    // Walk the whole map
+    start = nowNs();
+    staticMapForEach(&bench->map, sumCb);
+    total = nowNs() - start;
+    printRow("foreach", scheme, dist, bench, load, n, total, false);
+
+    // Remove everything, timed per operation
+    total = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t key = keys[i];
+        start = nowNs();
+        if (staticMapRemoveByKey(&bench->map, key) != STATIC_MAP_SUCCESS) {
+            return 1;
+        }
+        latencies[i] = timedSince(start);
+        total += latencies[i];
+    }
+    printRow("remove", scheme, dist, bench, load, n, total, true);
+
+    // New keys the two pass way, a find followed by an insert
+    benchMapInit(bench, scheme, bench->length, bench->item_size);
+    start = nowNs();
+    for (uint32_t i = 0; i < n; i++) {
+        if (staticMapFind(&bench->map, keys[i]) == NULL && staticMapInsertAndGet(&bench->map, keys[i]) == NULL) {
+            return 1;
+        }
+    }
+    total = nowNs() - start;
+    printRow("find_then_insert", scheme, dist, bench, load, n, total, false);
+
+    // The same keys in a single probe pass each
+    benchMapInit(bench, scheme, bench->length, bench->item_size);
+    start = nowNs();
+    for (uint32_t i = 0; i < n; i++) {
+        staticMapItem_t *item;
+        if (staticMapFindOrInsert(&bench->map, keys[i], &item) < 0) {
+            return 1;
+        }
+    }
+    total = nowNs() - start;
+    printRow("find_or_insert", scheme, dist, bench, load, n, total, false);
+
+    return 0;
+}
+
+/**
+ * Keep the map at 90% load and replace the oldest key with a new one, round after round.
+ * Miss lookups are measured at every checkpoint, so any build up of tombstones or
+ * growing clusters shows as a rising miss latency.
+ */
+static int runChurnBench(benchMap_t *bench, const scheme_t *scheme, keyDist_t dist, uint32_t rounds) {
+    size_t n = (size_t)((double)bench->length * 0.9);
+    size_t churn_ops = bench->length * rounds;
+    size_t checkpoint = churn_ops / CHURN_CHECKPOINTS;
+
+    if (benchMapInit(bench, scheme, bench->length, bench->item_size) != STATIC_MAP_SUCCESS) {
+        return 1;
+    }
+
+    uint32_t oldest = 0;
+    uint32_t next = 0;
+    for (; next < n; next++) {
+        staticMapInsertAndGet(&bench->map, makeKey(dist, next, bench->length));
+    }
+
+    uint64_t churn_ns = 0;
+    for (size_t op = 1; op <= churn_ops; op++) {
+        uint64_t start = nowNs();
+        staticMapRemoveByKey(&bench->map, makeKey(dist, oldest++, bench->length));
+        if (staticMapInsertAndGet(&bench->map, makeKey(dist, next++, bench->length)) == NULL) {
+            return 1;
+        }
+        churn_ns += nowNs() - start;
+
+        if (op % checkpoint == 0) {
+            printRow("churn", scheme, dist, bench, 0.9, checkpoint, churn_ns, false);
+            churn_ns = 0;
+
+            size_t samples = bench->length / 4;
+            uint64_t total = 0;
+            for (uint32_t i = 0; i < samples; i++) {
+                uint32_t key = makeKey(dist, next + 1 + i, bench->length);
+                uint64_t start_miss = nowNs();
+                sink += (uintptr_t)staticMapFind(&bench->map, key);
+                latencies[i] = timedSince(start_miss);
+                total += latencies[i];
+            }
+            printRow("churn_find_miss", scheme, dist, bench, 0.9, samples, total, true);
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    uint32_t log2_length = DEFAULT_LOG2_LENGTH;
+    uint32_t churn_rounds = DEFAULT_CHURN_ROUNDS;
+
+    if (argc > 1) {
+        log2_length = (uint32_t)strtoul(argv[1], NULL, 0);
+    }
+    if (argc > 2) {
+        churn_rounds = (uint32_t)strtoul(argv[2], NULL, 0);
+    }
+
+    if (log2_length < 4 || log2_length > 24) {
+        fprintf(stderr, "Map length must be between 2^4 and 2^24\n");
+        return 1;
+    }
+
+    benchMap_t bench = {0};
+    bench.length    = (size_t)1 << log2_length;
+    bench.array     = malloc(bench.length * sizeof(bench.array[0]));
+    bench.storage   = malloc(bench.length * item_sizes[NUM_ITEM_SIZES - 1]);
+    bench.ctrl      = malloc(STATIC_MAP_CTRL_BYTES(bench.length));
+    latencies       = malloc(bench.length * sizeof(latencies[0]));
+    keys            = malloc(2 * bench.length * sizeof(keys[0]));
+    bulk_out        = malloc(bench.length * sizeof(bulk_out[0]));
+    bulk_scratch    = malloc(2 * bench.length * sizeof(bulk_scratch[0]));
+
+    if (bench.array == NULL || bench.storage == NULL || bench.ctrl == NULL || latencies == NULL || keys == NULL ||
+        bulk_out == NULL || bulk_scratch == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    calibrateTimer();
+    printHeader();
+
+    for (size_t s = 0; s < NUM_SCHEMES; s++) {
+        for (size_t size = 0; size < NUM_ITEM_SIZES; size++) {
+            bench.item_size = item_sizes[size];
+            for (int dist = 0; dist < KEYS_NUM; dist++) {
+                for (size_t load = 0; load < NUM_LOAD_FACTORS; load++) {
+                    if (runLoadBench(&bench, &schemes[s], (keyDist_t)dist, load_factors[load]) != 0) {
+                        fprintf(stderr, "Benchmark %s failed\n", schemes[s].name);
+                        return 1;
+                    }
+                }
+            }
+        }
+
+        bench.item_size = item_sizes[0];
+        for (int dist = 0; dist < KEYS_NUM; dist++) {
+            if (runChurnBench(&bench, &schemes[s], (keyDist_t)dist, churn_rounds) != 0) {
+                fprintf(stderr, "Churn benchmark %s failed\n", schemes[s].name);
+                return 1;
+            }
+        }
+    }
+
+    free(bench.array);
+    free(bench.storage);
+    free(bench.ctrl);
+    free(latencies);
+    free(keys);
+    free(bulk_out);
+    free(bulk_scratch);
+
+    return 0;
+}
@@ -0,0 +1,247 @@
+/**
+ * @file:       static_dense_map.c
+ * @author:     Lucas Wennerholm <lucas.wennerholm@gmail.com>
+ * @brief:      Static map with a dense item pool and a separate hash index
+ *
+ * @license: MIT License
+ *
+ * Copyright (c) 2025 Lucas Wennerholm
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "static_dense_map.h"
+#include <string.h>
+
+// Hash a key with the map hash function
+static inline uint32_t denseHash(const staticDenseMap_t *map, uint32_t key) {
+    return map->hash != NULL ? map->hash(key, map->seed) : staticMapHashMix32(key, map->seed);
+}
+
+// Home slot of a key in the index, power of two indices use a mask
+static inline uint32_t denseHome(const staticDenseMap_t *map, uint32_t key) {
+    uint32_t hash = denseHash(map, key);
+    return map->mask ? (hash & map->mask) : (uint32_t)(hash % map->index_length);
+}
+
+static inline uint32_t denseNext(const staticDenseMap_t *map, uint32_t slot) {
+    return (slot + 1 == map->index_length) ? 0 : slot + 1;
+}
+
+// Distance from a to b when walking forward in the index
+static inline uint32_t denseDistance(const staticDenseMap_t *map, uint32_t from, uint32_t to) {
+    return (to >= from) ? (to - from) : (uint32_t)(map->index_length - from + to);
+}
+
+// Index slot of a key, or of the empty slot that ends its probe. The index always has an empty slot
+static uint32_t denseProbe(const staticDenseMap_t *map, uint32_t key, bool *found) {
+    uint32_t slot = denseHome(map, key);
+
+    while (map->index[slot] != STATIC_DENSE_MAP_EMPTY) {
+        if (staticDenseMapItemAt(map, map->index[slot])->key == key) {
+            *found = true;
+            return slot;
+        }
+        slot = denseNext(map, slot);
+    }
+
+    *found = false;
+    return slot;
+}
+
+/**
+ * Empty an index slot and pull the rest of the cluster back towards the home slots,
+ * see backwardShift in static_map.c. Only the uint32_t entries move, the items are not touched
+ * except for their slot field
+ */
+static void denseShift(staticDenseMap_t *map, uint32_t hole) {
+    map->index[hole] = STATIC_DENSE_MAP_EMPTY;
+
+    for (uint32_t slot = denseNext(map, hole); map->index[slot] != STATIC_DENSE_MAP_EMPTY; slot = denseNext(map, slot)) {
+        staticDenseMapItem_t *item = staticDenseMapItemAt(map, map->index[slot]);
+        uint32_t home = denseHome(map, item->key);
+
+        // The entry may move if the hole lies between its home and its current slot
+        if (denseDistance(map, home, slot) >= denseDistance(map, hole, slot)) {
+            map->index[hole] = map->index[slot];
+            map->index[slot] = STATIC_DENSE_MAP_EMPTY;
+            item->slot = hole;
+            hole = slot;
+        }
+    }
+}
+
+int32_t staticDenseMapInit(staticDenseMap_t *map, uint32_t *index, size_t index_length, size_t length, size_t item_size,
+                           staticDenseMapItem_t *first_item, size_t node_offset, const staticMapConfig_t *config) {
+    if (map == NULL || index == NULL || length == 0 || first_item == NULL || item_size < sizeof(staticDenseMapItem_t)) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    // Probes stop at the first empty index slot, so there must always be one
+    if (index_length <= length || index_length > UINT32_MAX || node_offset + sizeof(staticDenseMapItem_t) > item_size) {
+        return STATIC_MAP_INVALID_CONFIG;
+    }
+
+    staticMapConfig_t defaults = {0};
+    if (config == NULL) {
+        config = &defaults;
+    }
+
+    // The index is plain linear probing, the other map features do not apply
+    if (config->probe != STATIC_MAP_PROBE_LINEAR || config->ctrl != NULL || config->capacity != 0 ||
+        config->evict != NULL || config->concurrent) {
+        return STATIC_MAP_INVALID_CONFIG;
+    }
+
+    for (size_t slot = 0; slot < index_length; slot++) {
+        index[slot] = STATIC_DENSE_MAP_EMPTY;
+    }
+
+    map->index        = index;
+    map->index_length = index_length;
+    map->mask         = ((index_length & (index_length - 1)) == 0) ? (uint32_t)(index_length - 1) : 0;
+    map->base         = (uint8_t *)first_item;
+    map->item_size    = item_size;
+    map->node_offset  = node_offset;
+    map->length       = length;
+    map->count        = 0;
+    map->hash         = config->hash;
+    map->seed         = config->seed;
+
+    return STATIC_MAP_SUCCESS;
+}
+
+staticDenseMapItem_t *staticDenseMapInsertAndGet(staticDenseMap_t *map, uint32_t key) {
+    if (map == NULL || map->count == map->length) {
+        return NULL;
+    }
+
+    bool found = false;
+    uint32_t slot = denseProbe(map, key, &found);
+    if (found) {
+        // The key is not unique, that is not a valid use case
+        return NULL;
+    }
+
+    // The first free item is always the one after the live ones
+    uint32_t position = (uint32_t)map->count++;
+    staticDenseMapItem_t *item = staticDenseMapItemAt(map, position);
+
+    item->key  = key;
+    item->slot = slot;
+    map->index[slot] = position;
+
+    return item;
+}
+
+staticDenseMapItem_t *staticDenseMapFind(staticDenseMap_t *map, uint32_t key) {
+    if (map == NULL) {
+        return NULL;
+    }
+
+    bool found = false;
+    uint32_t slot = denseProbe(map, key, &found);
+    return found ? staticDenseMapItemAt(map, map->index[slot]) : NULL;
+}
+
+int32_t staticDenseMapRemove(staticDenseMap_t *map, staticDenseMapItem_t *item) {
+    if (map == NULL || item == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    size_t offset = (size_t)((uint8_t *)item - map->base);
+    if ((uint8_t *)item < map->base || offset % map->item_size != 0 || offset / map->item_size >= map->length) {
+        // Not an item of this pool
+        return STATIC_MAP_INVALID_KEY;
+    }
+
+    uint32_t position = (uint32_t)(offset / map->item_size);
+    if (position >= map->count || item->slot >= map->index_length || map->index[item->slot] != position) {
+        // Already removed, similar to a double free
+        return STATIC_MAP_UNUSED_ERASE;
+    }
+
+    denseShift(map, item->slot);
+
+    // Keep the pool dense, the last live item fills the hole. The shift above may have moved
+    // its index entry, so the copied slot field is already current
+    uint32_t last = (uint32_t)--map->count;
+    if (position != last) {
+        staticDenseMapItem_t *last_item = staticDenseMapItemAt(map, last);
+        memcpy((uint8_t *)item - map->node_offset, (uint8_t *)last_item - map->node_offset, map->item_size);
+        map->index[item->slot] = position;
+    }
+
+    return STATIC_MAP_SUCCESS;
+}
+
+int32_t staticDenseMapRemoveByKey(staticDenseMap_t *map, uint32_t key) {
+    if (map == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    staticDenseMapItem_t *item = staticDenseMapFind(map, key);
+    if (item == NULL) {
+        return STATIC_MAP_UNUSED_ERASE;
+    }
+
+    return staticDenseMapRemove(map, item);
+}
+
+int32_t staticDenseMapForEach(staticDenseMap_t *map, int32_t (*callback)(staticDenseMap_t *map, staticDenseMapItem_t *item)) {
+    if (map == NULL || callback == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    int32_t result = STATIC_MAP_SUCCESS;
+    uint32_t position = 0;
+
+    while (position < map->count) {
+        staticDenseMapItem_t *item = staticDenseMapItemAt(map, position);
+
+        int32_t cb_res = callback(map, item);
+        if (cb_res == STATIC_MAP_CB_NEXT) {
+            position++;
+            continue;
+        }
+
+        if (cb_res == STATIC_MAP_CB_ERASE) {
+            // The last item moves into this position, visit it next
+            if ((result = staticDenseMapRemove(map, item)) != STATIC_MAP_SUCCESS) {
+                break;
+            }
+            continue;
+        }
+
+        if (cb_res != STATIC_MAP_CB_STOP) {
+            result = cb_res;
+        }
+        break;
+    }
+
+    return result;
+}
+
+int32_t staticDenseMapGetNumItems(const staticDenseMap_t *map) {
+    if (map == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    return (int32_t)map->count;
+}
@@ -0,0 +1,158 @@
+/**
+ * @file:       static_dense_map.h
+ * @author:     Lucas Wennerholm <lucas.wennerholm@gmail.com>
+ * @brief:      Static map with a dense item pool and a separate hash index
+ *
+ * @license: MIT License
+ *
+ * Copyright (c) 2025 Lucas Wennerholm
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * In a staticMap_t the slot of an item is also its hash bucket, so the live items are spread
+ * over the whole item array. A dense map keeps them apart: the items live in a pool where the
+ * live ones are always the first count, and the hash index is an array of uint32_t pool
+ * positions. Inserts take the next pool item, removals move the last live item into the hole.
+ *
+ * Walking the map is a linear scan over exactly count items, and a half empty map only
+ * touches the front half of the pool. The price is that a removal moves one item, so
+ * pointers to items are only valid until the next remove, as in a strided map.
+ *
+ *  typedef struct { staticDenseMapItem_t node; uint32_t packets; } flow_t;
+ *  static flow_t flows[1024];
+ *  static uint32_t flow_index[2048];
+ *  static staticDenseMap_t flow_map;
+ *
+ *  STATIC_DENSE_MAP_INIT(flow_map, flow_index, 2048, flows, 1024, node, NULL);
+ *  for (uint32_t i = 0; i < staticDenseMapGetNumItems(&flow_map); i++) {
+ *      flow_t *flow = CONTAINER_OF(staticDenseMapItemAt(&flow_map, i), flow_t, node);
+ *  }
+ */
+
+#ifndef STATIC_DENSE_MAP_H
+#define STATIC_DENSE_MAP_H
+
+#include "static_map.h"
+
+#define STATIC_DENSE_MAP_EMPTY UINT32_MAX // Index entry without an item
+
+/**
+ * This item should be embedded into the struct that is put in the map
+ */
+typedef struct {
+    uint32_t key;  // This is the map key
+    uint32_t slot; // Index entry that points at this item, kept up to date by the map
+} staticDenseMapItem_t;
+
+typedef struct {
+    uint32_t       *index;        // Pool position of the item in every index slot, STATIC_DENSE_MAP_EMPTY if unused
+    size_t          index_length; // Number of index slots
+    uint32_t        mask;         // index_length - 1 when it is a power of two, otherwise 0
+    uint8_t        *base;         // Node of the first user struct
+    size_t          item_size;    // Distance between the user structs
+    size_t          node_offset;  // Offset of the node in the user struct, removals copy whole structs
+    size_t          length;       // Number of items in the pool
+    size_t          count;        // Live items, pool positions 0..count-1
+    staticMapHash_t hash;         // Hash function, NULL for staticMapHashMix32
+    uint32_t        seed;         // Seed passed to the hash function
+} staticDenseMap_t;
+
+/**
+ * Initialize a dense map. The index must have more slots than the pool has items,
+ * so that every probe ends on an empty slot. Twice the pool length keeps the probes short.
+ * Only the hash and seed of the configuration are used, any other setting is rejected
+ * Input: Pointer to a dense map instance
+ * Input: Index array
+ * Input: Number of index slots
+ * Input: Number of items in the pool
+ * Input: Size of the user struct
+ * Input: Pointer to the node in the first user struct
+ * Input: Offset of the node in the user struct, offsetof(type, member)
+ * Input: Pointer to a map configuration, NULL gives the default hash
+ * Returns: staticMapErr_t
+ */
+int32_t staticDenseMapInit(staticDenseMap_t *map, uint32_t *index, size_t index_length, size_t length, size_t item_size,
+                           staticDenseMapItem_t *first_item, size_t node_offset, const staticMapConfig_t *config);
+
+/**
+ * Take the next pool item for a new key
+ * Input: Pointer to a dense map instance
+ * Input: Key to new item
+ * Returns: The new item, NULL if the key exists or the pool is full
+ */
+staticDenseMapItem_t *staticDenseMapInsertAndGet(staticDenseMap_t *map, uint32_t key);
+
+/**
+ * Find an item given the key
+ * Input: Pointer to a dense map instance
+ * Input: The item key
+ * Returns: The item or NULL if no item was found
+ */
+staticDenseMapItem_t *staticDenseMapFind(staticDenseMap_t *map, uint32_t key);
+
+/**
+ * Remove an item. The last live item is copied into its place, so a pointer to it now
+ * points at the removed item
+ * Input: Pointer to a dense map instance
+ * Input: Item to remove
+ * Returns: staticMapErr_t
+ */
+int32_t staticDenseMapRemove(staticDenseMap_t *map, staticDenseMapItem_t *item);
+
+/**
+ * Remove the item of a key, see staticDenseMapRemove
+ * Input: Pointer to a dense map instance
+ * Input: key of item
+ * Returns: staticMapErr_t
+ */
+int32_t staticDenseMapRemoveByKey(staticDenseMap_t *map, uint32_t key);
+
+/**
+ * Call the callback on every item in pool order, see staticMapForEach.
+ * An erased item is replaced by the last one, which is visited next
+ * Input: Pointer to a dense map instance
+ * Input: Callback function
+ * Returns: staticMapErr_t
+ */
+int32_t staticDenseMapForEach(staticDenseMap_t *map, int32_t (*callback)(staticDenseMap_t *map, staticDenseMapItem_t *item));
+
+/**
+ * Item at a pool position, positions below staticDenseMapGetNumItems are live
+ * Input: Pointer to a dense map instance
+ * Input: Pool position
+ * Returns: The item
+ */
+static inline staticDenseMapItem_t *staticDenseMapItemAt(const staticDenseMap_t *map, uint32_t position) {
+    return (staticDenseMapItem_t *)(map->base + (size_t)position * map->item_size);
+}
+
+/**
+ * Get the number of items in the map
+ * Input: Pointer to a dense map instance
+ * Returns: Number of items in the map, STATIC_MAP_NULL_ERROR on error
+ */
+int32_t staticDenseMapGetNumItems(const staticDenseMap_t *map);
+
+#define STATIC_DENSE_MAP_INIT(map, index, index_length, list, length, member, config) \
+    staticDenseMapInit(&(map), (index), (index_length), (length), sizeof((list)[0]), &(list)[0].member, \
+                       (size_t)((uint8_t *)&(list)[0].member - (uint8_t *)&(list)[0]), (config))
+
+#endif /* STATIC_DENSE_MAP_H */
@@ -27,234 +27,2870 @@
 */
 
 #include "static_map.h"
+#include "static_map_internal.h"
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 // For linear probing, once we collide at index = hash(key),
-// we'll do: index = (index + 1) % length
-#define LINEAR_PROBE(i, length)  (((i) + 1) % (length))
+// we'll do: index = index + 1, wrapping at the end of the map.
+// Power of two maps wrap with the mask, no division on the probe path.
+#define LINEAR_PROBE(i, map)  ((map)->mask ? (((i) + 1) & (map)->mask) : \
+                               (((i) + 1 == (map)->length) ? 0 : (i) + 1))
+
+// Murmur3 finalizer, every input bit affects every output bit
+static inline uint32_t mix32(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
+}
+
+uint32_t staticMapHashMix32(uint32_t key, uint32_t seed) {
+    return mix32(key ^ seed);
+}
+
+uint32_t staticMapHashFibonacci(uint32_t key, uint32_t seed) {
+    // Multiply by 2^32 / golden ratio, the high bits are well mixed so fold them down
+    uint32_t h = (key ^ seed) * 0x9e3779b9U;
+    return h ^ (h >> 16);
+}
+
+uint32_t staticMapHashIdentity(uint32_t key, uint32_t seed) {
+    return key ^ seed;
+}
+
+// Hash a key with the map hash function, the default mixer is inlined
+static inline uint32_t hash_key(const staticMap_t *map, uint32_t key) {
+    if (map->hash == NULL) {
+        return mix32(key ^ map->seed);
+    }
+    return map->hash(key, map->seed);
+}
+
+// Reduce a hash to a bucket, power of two maps use a mask
+static inline uint32_t hash_bucket(const staticMap_t *map, uint32_t hash) {
+    return map->mask ? (hash & map->mask) : (uint32_t)(hash % map->length);
+}
+
+// Map a 32-bit hash onto 0..range-1 without a division
+static inline uint32_t fastRange(uint32_t hash, uint32_t range) {
+    return (uint32_t)(((uint64_t)hash * range) >> 32);
+}
+
+// Hash of the key in a slot, maps that store hashes never call the hash function again
+static inline uint32_t slotHash(const staticMap_t *map, const staticMapItem_t *slot) {
+#ifdef STATIC_MAP_STORED_HASH
+    (void)map;
+    return slot->hash;
+#else
+    return hash_key(map, slot->key);
+#endif
+}
+
+// Stored hashes reject most other keys before the key itself is compared
+#ifdef STATIC_MAP_STORED_HASH
+#define KEY_MATCHES(slot, k, h) ((slot)->hash == (h) && (slot)->key == (k))
+#else
+#define KEY_MATCHES(slot, k, h) ((slot)->key == (k))
+#endif
+
+// Per operation accounting, compiled out unless STATIC_MAP_STATS is defined
+#ifdef STATIC_MAP_STATS
+#define STATS_INC(map, field)   ((map)->counters.field++)
+#define STATS_DEC(map, field)   ((map)->counters.field--)
+#define STATS_PROBE(map, n)     statsProbe((map), (n))
+
+static inline void statsProbe(staticMap_t *map, uint32_t probes) {
+    map->counters.probes += probes;
+    if (probes > map->counters.max_probe) {
+        map->counters.max_probe = probes;
+    }
+}
+#else
+#define STATS_INC(map, field)   ((void)0)
+#define STATS_DEC(map, field)   ((void)0)
+#define STATS_PROBE(map, n)     ((void)0)
+#endif
+
+// Batch operations hash and prefetch this many keys before probing them
+#define BATCH_CHUNK 16
+
+#if defined(__GNUC__)
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr) ((void)(addr))
+#endif
+
+// Control byte values, a full slot stores the top 7 bits of the key hash
+#define CTRL_EMPTY    0x80
+#define CTRL_DELETED  0xFE
+
+// The control byte fingerprint for a hash
+static inline uint8_t hash_h2(uint32_t hash) {
+    return (uint8_t)(hash >> 25);
+}
+
+/**
+ * Group matching returns a bitmask with bit i set when byte i of the group matches.
+ * SSE2 compares all 16 bytes in one instruction, the portable version works on two
+ * 64-bit words at a time.
+ */
+#if defined(__SSE2__)
+static inline uint32_t groupMatch(const uint8_t *group, uint8_t h2) {
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)h2)));
+}
+
+static inline uint32_t groupMatchEmpty(const uint8_t *group) {
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)CTRL_EMPTY)));
+}
+
+static inline uint32_t groupMatchFree(const uint8_t *group) {
+    // Empty and deleted are the only values with the top bit set
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+}
+#else
+#define SWAR_LSB 0x0101010101010101ULL
+#define SWAR_MSB 0x8080808080808080ULL
+
+static inline uint64_t swarLoad(const uint8_t *bytes) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+// Gather the top bit of each byte into the low 8 bits
+static inline uint32_t swarMask(uint64_t msb) {
+    return (uint32_t)(((msb >> 7) * 0x0102040810204080ULL) >> 56);
+}
+
+static inline uint32_t swarMatch(uint64_t word, uint8_t h2) {
+    // May report a false positive next to a true match, the key compare filters those out
+    uint64_t x = word ^ (SWAR_LSB * h2);
+    return swarMask((x - SWAR_LSB) & ~x & SWAR_MSB);
+}
+
+static inline uint32_t groupMatch(const uint8_t *group, uint8_t h2) {
+    return swarMatch(swarLoad(group), h2) | (swarMatch(swarLoad(group + 8), h2) << 8);
+}
+
+static inline uint32_t swarMatchEmpty(uint64_t word) {
+    // Empty is the only value with bit 7 set and bit 1 clear
+    return swarMask(word & ~(word << 6) & SWAR_MSB);
+}
+
+static inline uint32_t groupMatchEmpty(const uint8_t *group) {
+    return swarMatchEmpty(swarLoad(group)) | (swarMatchEmpty(swarLoad(group + 8)) << 8);
+}
+
+static inline uint32_t groupMatchFree(const uint8_t *group) {
+    return swarMask(swarLoad(group) & SWAR_MSB) | (swarMask(swarLoad(group + 8) & SWAR_MSB) << 8);
+}
+#endif
+
+// Set the control byte of a slot, the first bytes are mirrored past the end so a group load never wraps
+static inline void ctrlSet(staticMap_t *map, uint32_t index, uint8_t value) {
+    if (map->ctrl == NULL) {
+        return;
+    }
+
+    map->ctrl[index] = value;
+    for (size_t mirror = index + map->length; mirror < map->length + STATIC_MAP_GROUP_WIDTH - 1; mirror += map->length) {
+        map->ctrl[mirror] = value;
+    }
+}
+
+// Wrap a slot index that may have run past the end of the map
+static inline uint32_t wrapIndex(staticMap_t *map, uint32_t index) {
+    if (map->mask) {
+        return index & map->mask;
+    }
+
+    while (index >= map->length) {
+        index -= (uint32_t)map->length;
+    }
+    return index;
+}
+
+// Distance from a to b when walking forward in the probe sequence
+static inline uint32_t probeDistance(staticMap_t *map, uint32_t from, uint32_t to) {
+    return (to >= from) ? (to - from) : (uint32_t)(map->length - from + to);
+}
+
+/**
+ * Cuckoo maps split the slots into buckets of CUCKOO_WAYS slots. Every key may live in one of
+ * two buckets, the slots past the last whole bucket are the stash for keys that fit in neither
+ */
+#define CUCKOO_WAYS  4
+#define CUCKOO_STASH 4 // Smallest stash, the remainder of the slots is added to it
+
+static inline uint32_t cuckooBuckets(const staticMap_t *map) {
+    return (uint32_t)((map->length - CUCKOO_STASH) / CUCKOO_WAYS);
+}
+
+static inline uint32_t cuckooStash(const staticMap_t *map) {
+    return cuckooBuckets(map) * CUCKOO_WAYS;
+}
+
+// First slot of the first and second bucket of a hash, the two always differ. The range reduction
+// uses the high bits, the multiply moves the low bits of weak hashes such as staticMapHashIdentity up
+static inline uint32_t cuckooFirst(const staticMap_t *map, uint32_t hash) {
+    return fastRange(hash * 0x9e3779b9U, cuckooBuckets(map)) * CUCKOO_WAYS;
+}
+
+static inline uint32_t cuckooSecond(const staticMap_t *map, uint32_t hash) {
+    uint32_t buckets = cuckooBuckets(map);
+    uint32_t first   = fastRange(hash * 0x9e3779b9U, buckets);
+    uint32_t second  = fastRange(mix32(hash), buckets);
+
+    if (second == first) {
+        second = (first + 1 == buckets) ? 0 : first + 1;
+    }
+    return second * CUCKOO_WAYS;
+}
+
+// Cuckoo maps need two buckets and the stash. Lookups do not walk a cluster, so there
+// are no control byte groups to match and no plain slot walk for concurrent readers
+static inline bool cuckooConfigValid(size_t length, bool ctrl, bool concurrent) {
+    return length >= CUCKOO_STASH + 2 * CUCKOO_WAYS && !ctrl && !concurrent;
+}
+
+// How far the item stored at index is from its home bucket. In a cuckoo map this is
+// the number of buckets a lookup reads before the one holding the item, the stash counts as the third
+static inline uint32_t homeDistance(staticMap_t *map, staticMapItem_t *slot, uint32_t index) {
+    if (map->probe == STATIC_MAP_PROBE_CUCKOO) {
+        if (index >= cuckooStash(map)) {
+            return 2;
+        }
+        return index / CUCKOO_WAYS == cuckooFirst(map, slotHash(map, slot)) / CUCKOO_WAYS ? 0 : 1;
+    }
+
+    return probeDistance(map, hash_bucket(map, slotHash(map, slot)), index);
+}
+
+// Store a field that concurrent readers may load, compiles to a plain store
+#define PUBLISH(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+
+#if defined(STATIC_MAP_COMPACT_NODE) && !defined(STATIC_MAP_UNORDERED)
+// Compact nodes keep the state in the top bits of the prev link
+static inline staticMapslotState_t nodeStateAtomic(const staticMapItem_t *item) {
+    return (staticMapslotState_t)(__atomic_load_n(&item->prev_state, __ATOMIC_RELAXED) >> STATIC_MAP_LINK_BITS);
+}
+
+static inline void nodeSetState(staticMapItem_t *item, staticMapslotState_t state) {
+    PUBLISH(item->prev_state, (staticMapLink_t)((item->prev_state & STATIC_MAP_LINK_MASK) |
+                                                ((staticMapLink_t)state << STATIC_MAP_LINK_BITS)));
+}
+#else
+static inline staticMapslotState_t nodeStateAtomic(const staticMapItem_t *item) {
+    return (staticMapslotState_t)__atomic_load_n(&item->state, __ATOMIC_RELAXED);
+}
+
+static inline void nodeSetState(staticMapItem_t *item, staticMapslotState_t state) {
+    PUBLISH(item->state, state);
+}
+#endif
+
+#ifdef STATIC_MAP_UNORDERED
+// Unordered maps keep no list
+static inline void listPushHead(staticMap_t *map, staticMapItem_t *item) {
+    (void)map;
+    (void)item;
+}
+
+static inline void listAddNew(staticMap_t *map, staticMapItem_t *item) {
+    (void)map;
+    (void)item;
+}
+
+static inline bool nodePending(staticMap_t *map, staticMapItem_t *item) {
+    (void)map;
+    (void)item;
+    return false;
+}
+
+static inline void listUnlink(staticMap_t *map, staticMapItem_t *item) {
+    (void)map;
+    (void)item;
+}
+#else
+#ifdef STATIC_MAP_COMPACT_NODE
+// Compact nodes link items by storage index
+static inline staticMapLink_t linkOf(staticMap_t *map, staticMapItem_t *item) {
+    if (item == NULL) {
+        return STATIC_MAP_LINK_NONE;
+    }
+    return (staticMapLink_t)(((uint8_t *)item - map->base) / map->item_size);
+}
+
+static inline staticMapItem_t *nodePrev(staticMap_t *map, staticMapItem_t *item) {
+    staticMapLink_t link = item->prev_state & STATIC_MAP_LINK_MASK;
+    if (link == STATIC_MAP_LINK_NONE) {
+        return NULL;
+    }
+    return (staticMapItem_t *)(map->base + (size_t)link * map->item_size);
+}
+
+static inline void nodeSetNext(staticMap_t *map, staticMapItem_t *item, staticMapItem_t *next) {
+    item->next = linkOf(map, next);
+}
+
+static inline void nodeSetPrev(staticMap_t *map, staticMapItem_t *item, staticMapItem_t *prev) {
+    PUBLISH(item->prev_state, (staticMapLink_t)((item->prev_state & ~STATIC_MAP_LINK_MASK) | linkOf(map, prev)));
+}
+#else
+static inline staticMapItem_t *nodePrev(staticMap_t *map, staticMapItem_t *item) {
+    (void)map;
+    return item->prev;
+}
+
+static inline void nodeSetNext(staticMap_t *map, staticMapItem_t *item, staticMapItem_t *next) {
+    (void)map;
+    item->next = next;
+}
+
+static inline void nodeSetPrev(staticMap_t *map, staticMapItem_t *item, staticMapItem_t *prev) {
+    (void)map;
+    item->prev = prev;
+}
+#endif
+
+static inline void listPushHead(staticMap_t *map, staticMapItem_t *item) {
+    // Insert at the HEAD (newest)
+    nodeSetPrev(map, item, map->head);
+    nodeSetNext(map, item, NULL);
+
+    if (map->head) {
+        nodeSetNext(map, map->head, item);
+    }
+
+    map->head = item;
+
+    // If there was no tail, this is also the tail (oldest)
+    if (!map->tail) {
+        map->tail = item;
+    }
+}
+
+/**
+ * A bulk insert links its new items in one pass at the end. Until then such an item has no
+ * prev link without being the tail, and its next link holds the index of its key instead,
+ * so the item can be matched with its key again after placement moved it
+ */
+static inline bool nodePending(staticMap_t *map, staticMapItem_t *item) {
+    return nodePrev(map, item) == NULL && item != map->tail;
+}
+
+static inline size_t nodePendingKey(const staticMapItem_t *item) {
+#ifdef STATIC_MAP_COMPACT_NODE
+    return (size_t)item->next;
+#else
+    return (size_t)(uintptr_t)item->next;
+#endif
+}
+
+// New items go to the head, or wait for the link pass at the end of a bulk insert
+static inline void listAddNew(staticMap_t *map, staticMapItem_t *item) {
+    if (map->bulk_key == 0) {
+        listPushHead(map, item);
+        return;
+    }
+
+    nodeSetPrev(map, item, NULL);
+#ifdef STATIC_MAP_COMPACT_NODE
+    item->next = (staticMapLink_t)(map->bulk_key - 1);
+#else
+    item->next = (staticMapItem_t *)(uintptr_t)(map->bulk_key - 1);
+#endif
+}
+
+static inline void listUnlink(staticMap_t *map, staticMapItem_t *item) {
+    staticMapItem_t *prev = nodePrev(map, item);
+    staticMapItem_t *next = staticMapItemNext(map, item);
+
+    if (prev) {
+        nodeSetNext(map, prev, next);
+    } else {
+        // If no prev, this was the tail
+        map->tail = next;
+    }
+
+    if (next) {
+        nodeSetPrev(map, next, prev);
+    } else {
+        // If no next, this was the head
+        map->head = prev;
+    }
+
+    nodeSetNext(map, item, NULL);
+    nodeSetPrev(map, item, NULL);
+}
+#endif
+
+// Point the list neighbours of an item that was copied to a new address at the copy
+static inline void listRelink(staticMap_t *map, staticMapItem_t *item) {
+#ifdef STATIC_MAP_UNORDERED
+    (void)map;
+    (void)item;
+#else
+    staticMapItem_t *prev = nodePrev(map, item);
+    staticMapItem_t *next = staticMapItemNext(map, item);
+
+    if (prev) {
+        nodeSetNext(map, prev, item);
+    } else {
+        map->tail = item;
+    }
+
+    if (next) {
+        nodeSetPrev(map, next, item);
+    } else {
+        map->head = item;
+    }
+#endif
+}
+
+/**
+ * Move the item at from into the free slot at to, the free item struct takes its place.
+ * Strided maps have no pointers to swap, the item is copied and its list neighbours fixed up
+ */
+static inline void moveSlot(staticMap_t *map, uint32_t from, uint32_t to) {
+    if (map->items != NULL) {
+        staticMapItem_t *tmp = map->items[to];
+        PUBLISH(map->items[to], map->items[from]);
+        PUBLISH(map->items[from], tmp);
+    } else {
+        staticMapItem_t *src = staticMapSlotItem(map, from);
+        staticMapItem_t *dst = staticMapSlotItem(map, to);
+        staticMapslotState_t free_state = staticMapItemState(dst);
+        bool pending = nodePending(map, src);
+
+        memcpy((uint8_t *)dst - map->node_offset, (uint8_t *)src - map->node_offset, map->item_size);
+        if (!pending) {
+            listRelink(map, dst);
+        }
+        nodeSetState(src, free_state);
+    }
+
+    if (map->ctrl != NULL) {
+        uint8_t ctrl = map->ctrl[to];
+        ctrlSet(map, to, map->ctrl[from]);
+        ctrlSet(map, from, ctrl);
+    }
+}
+
+// Find the slot index holding this exact item, or map->length if it is not in the map
+static uint32_t findItemIndex(staticMap_t *map, staticMapItem_t *item) {
+    if (map->items == NULL) {
+        // Strided items live in their slot
+        size_t offset = (size_t)((uint8_t *)item - map->base);
+        if ((uint8_t *)item < map->base || offset % map->item_size != 0 || offset / map->item_size >= map->length) {
+            return map->length;
+        }
+        return (uint32_t)(offset / map->item_size);
+    }
+
+    if (map->probe == STATIC_MAP_PROBE_CUCKOO) {
+        // The two buckets, then the stash
+        uint32_t hash = slotHash(map, item);
+        uint32_t first = cuckooFirst(map, hash);
+        uint32_t second = cuckooSecond(map, hash);
+
+        for (uint32_t way = 0; way < CUCKOO_WAYS; way++) {
+            if (map->items[first + way] == item) {
+                return first + way;
+            }
+            if (map->items[second + way] == item) {
+                return second + way;
+            }
+        }
+
+        for (uint32_t index = cuckooStash(map); index < map->length; index++) {
+            if (map->items[index] == item) {
+                return index;
+            }
+        }
+        return map->length;
+    }
+
+    uint32_t index = hash_bucket(map, slotHash(map, item));
+
+    for (uint32_t attempt = 0; attempt < map->length; attempt++) {
+        staticMapItem_t *slot = staticMapSlotItem(map, index);
+
+        if (slot == item) {
+            return index;
+        }
+        else if (staticMapItemState(slot) == STATIC_MAP_SLOT_EMPTY) {
+            break;
+        }
+        index = LINEAR_PROBE(index, map);
+    }
+
+    return map->length;
+}
+
+// Returned by a probe step when the key is neither found nor proven absent yet
+#define PROBE_CONTINUE 1
+
+/**
+ * A probe that can be advanced one step at a time, so several lookups can be interleaved.
+ * A step inspects one slot, or one group of control bytes when the map has them.
+ */
+typedef struct {
+    uint32_t key;
+    uint32_t hash;
+    uint32_t index;   // Next slot, or start of the next group, to inspect
+    uint32_t attempt; // Number of slots or groups inspected so far
+} probeState_t;
+
+static inline void probeStart(staticMap_t *map, probeState_t *probe, uint32_t key, uint32_t hash) {
+    probe->key     = key;
+    probe->hash    = hash;
+    probe->index   = map->probe == STATIC_MAP_PROBE_CUCKOO ? cuckooFirst(map, hash) : hash_bucket(map, hash);
+    probe->attempt = 0;
+}
+
+/**
+ * Inspect the next group of control bytes. Only slots whose fingerprint matches are dereferenced.
+ * When free is not NULL it is set to the first empty or deleted slot seen, if it is still map->length.
+ */
+static inline int32_t groupStep(staticMap_t *map, probeState_t *probe, uint32_t *found, uint32_t *free) {
+    size_t probed = (size_t)probe->attempt * STATIC_MAP_GROUP_WIDTH;
+    if (probed >= map->length) {
+        return STATIC_MAP_INVALID_KEY;
+    }
+
+    const uint8_t *group = &map->ctrl[probe->index];
+    uint32_t empty = groupMatchEmpty(group);
+    uint32_t match = groupMatch(group, hash_h2(probe->hash));
+
+    probe->attempt++;
+
+    if (empty) {
+        // The key can not be stored past the first empty slot
+        match &= (empty & (0U - empty)) - 1;
+    }
+
+    while (match) {
+        uint32_t slot_index = wrapIndex(map, probe->index + (uint32_t)__builtin_ctz(match));
+        staticMapItem_t *slot = staticMapSlotItem(map, slot_index);
+
+        if (KEY_MATCHES(slot, probe->key, probe->hash)) {
+            *found = slot_index;
+            return STATIC_MAP_SUCCESS;
+        }
+        match &= match - 1;
+    }
+
+    if (free != NULL && *free == map->length) {
+        uint32_t free_mask = groupMatchFree(group);
+        if (free_mask) {
+            uint32_t offset = (uint32_t)__builtin_ctz(free_mask);
+            if (probed + offset < map->length) {
+                *free = wrapIndex(map, probe->index + offset);
+            }
+        }
+    }
+
+    if (empty) {
+        return STATIC_MAP_UNUSED_ERASE;
+    }
+
+    probe->index = wrapIndex(map, probe->index + STATIC_MAP_GROUP_WIDTH);
+    return PROBE_CONTINUE;
+}
+
+// Inspect the next slot
+static inline int32_t slotStep(staticMap_t *map, probeState_t *probe, uint32_t *found) {
+    if (probe->attempt >= map->length) {
+        return STATIC_MAP_INVALID_KEY;
+    }
+
+    uint32_t index = probe->index;
+    staticMapItem_t *slot = staticMapSlotItem(map, index);
+
+    probe->attempt++;
+
+    if (staticMapItemState(slot) == STATIC_MAP_SLOT_EMPTY) {
+        // We hit an empty slot, means the key is not in the table
+        return STATIC_MAP_UNUSED_ERASE;
+    }
+    else if (staticMapItemState(slot) == STATIC_MAP_SLOT_IN_USE) {
+        if (KEY_MATCHES(slot, probe->key, probe->hash)) {
+            // Found it
+            *found = index;
+            return STATIC_MAP_SUCCESS;
+        }
+
+        // Robin Hood clusters are ordered by home bucket, so once the resident is closer
+        // to its home than we are to ours the key would already have been placed
+        if (map->probe == STATIC_MAP_PROBE_ROBIN_HOOD && homeDistance(map, slot, index) < probe->attempt - 1) {
+            return STATIC_MAP_UNUSED_ERASE;
+        }
+    }
+    // else tombstone or different key => keep probing
+    probe->index = LINEAR_PROBE(index, map);
+    return PROBE_CONTINUE;
+}
+
+/**
+ * Inspect the next cuckoo bucket, the first, then the second and last the stash.
+ * The stash is only read while something is in it
+ */
+static inline int32_t cuckooStep(staticMap_t *map, probeState_t *probe, uint32_t *found) {
+    uint32_t end = probe->attempt < 2 ? probe->index + CUCKOO_WAYS : (uint32_t)map->length;
+
+    for (uint32_t index = probe->index; index < end; index++) {
+        staticMapItem_t *slot = staticMapSlotItem(map, index);
+        if (staticMapItemState(slot) == STATIC_MAP_SLOT_IN_USE && KEY_MATCHES(slot, probe->key, probe->hash)) {
+            *found = index;
+            return STATIC_MAP_SUCCESS;
+        }
+    }
+
+    probe->attempt++;
+    if (probe->attempt == 1) {
+        probe->index = cuckooSecond(map, probe->hash);
+        return PROBE_CONTINUE;
+    }
+
+    if (probe->attempt == 2 && map->stashed != 0) {
+        probe->index = cuckooStash(map);
+        return PROBE_CONTINUE;
+    }
+
+    return STATIC_MAP_UNUSED_ERASE;
+}
+
+static inline int32_t probeStep(staticMap_t *map, probeState_t *probe, uint32_t *found) {
+    if (map->ctrl != NULL) {
+        return groupStep(map, probe, found, NULL);
+    }
+    if (map->probe == STATIC_MAP_PROBE_CUCKOO) {
+        return cuckooStep(map, probe, found);
+    }
+    return slotStep(map, probe, found);
+}
+
+// Prefetch whatever the next step of this probe is going to read
+static inline void probePrefetch(staticMap_t *map, probeState_t *probe) {
+    if (map->ctrl != NULL) {
+        PREFETCH(&map->ctrl[probe->index]);
+    } else {
+        PREFETCH(map->items != NULL ? (void *)&map->items[probe->index] : (void *)staticMapSlotItem(map, probe->index));
+    }
+}
+
+/**
+ * Group probe over the control bytes that also reports the first empty or deleted
+ * slot seen before the probe ended, or map->length if there was none.
+ */
+static int32_t probeGroups(staticMap_t *map, uint32_t key, uint32_t hash, uint32_t *found, uint32_t *free) {
+    probeState_t probe;
+    probeStart(map, &probe, key, hash);
+
+    *free = (uint32_t)map->length;
+
+    int32_t result;
+    while ((result = groupStep(map, &probe, found, free)) == PROBE_CONTINUE) {
+    }
+
+    return result;
+}
+
+/**
+ * Walk the probe sequence for key.
+ * Returns STATIC_MAP_SUCCESS and the slot index if found, STATIC_MAP_UNUSED_ERASE if the
+ * probe proved that the key is not in the map and STATIC_MAP_INVALID_KEY if every slot was checked.
+ */
+static int32_t probeFor(staticMap_t *map, uint32_t key, uint32_t hash, uint32_t *found) {
+    probeState_t probe;
+    probeStart(map, &probe, key, hash);
+
+    int32_t result;
+    while ((result = probeStep(map, &probe, found)) == PROBE_CONTINUE) {
+    }
+
+    STATS_PROBE(map, probe.attempt);
+    return result;
+}
+
+/**
+ * Turn the slot at index into an empty slot without leaving a tombstone.
+ * Entries further down the cluster are pulled back towards their home bucket
+ * by swapping pointers in map->items, so the user structs never move.
+ * Returns the slot that is empty in the end, it holds the struct of the removed entry
+ */
+static uint32_t backwardShift(staticMap_t *map, uint32_t hole) {
+    if (map->probe == STATIC_MAP_PROBE_CUCKOO) {
+        // A cuckoo lookup reads whole buckets, no entry depends on the slots next to it
+        if (hole >= cuckooStash(map) && staticMapItemState(staticMapSlotItem(map, hole)) != STATIC_MAP_SLOT_EMPTY) {
+            map->stashed--;
+        }
+        nodeSetState(staticMapSlotItem(map, hole), STATIC_MAP_SLOT_EMPTY);
+        return hole;
+    }
+
+    nodeSetState(staticMapSlotItem(map, hole), STATIC_MAP_SLOT_EMPTY);
+    ctrlSet(map, hole, CTRL_EMPTY);
+
+    uint32_t index = LINEAR_PROBE(hole, map);
+    for (uint32_t attempt = 1; attempt < map->length; attempt++) {
+        staticMapItem_t *slot = staticMapSlotItem(map, index);
+
+        if (staticMapItemState(slot) == STATIC_MAP_SLOT_EMPTY) {
+            // End of the cluster
+            break;
+        }
+
+        if (staticMapItemState(slot) == STATIC_MAP_SLOT_IN_USE) {
+            uint32_t home = hash_bucket(map, slotHash(map, slot));
+
+            // The entry may move if the hole lies between its home and its current slot
+            if (probeDistance(map, home, index) >= probeDistance(map, hole, index)) {
+                moveSlot(map, index, hole);
+                hole = index;
+            }
+            else if (map->probe == STATIC_MAP_PROBE_ROBIN_HOOD) {
+                // Clusters are ordered by home bucket, nothing after this entry can move either
+                break;
+            }
+        }
+        // Tombstones are left where they are, they only ever lengthen a probe
+
+        index = LINEAR_PROBE(index, map);
+    }
+
+    return hole;
+}
+
+// Returns the slot the struct of the removed entry ends up in, see backwardShift
+static uint32_t removeAt(staticMap_t *map, uint32_t index) {
+    staticMapItem_t *slot = staticMapSlotItem(map, index);
+
+    listUnlink(map, slot);
+    uint32_t hole = backwardShift(map, index);
+
+    map->count--;
+    STATS_INC(map, removes);
+
+    return hole;
+}
+
+#ifdef STATIC_MAP_UNORDERED
+// Remove without moving anything, used while iterating. staticMapCompact reclaims the slot
+static void tombstoneAt(staticMap_t *map, uint32_t index) {
+    nodeSetState(staticMapSlotItem(map, index), STATIC_MAP_SLOT_DELETED);
+    ctrlSet(map, index, CTRL_DELETED);
+
+    map->count--;
+    STATS_INC(map, removes);
+}
+#endif
+
+static inline staticMapItem_t *placeInSlot(staticMap_t *map, uint32_t index, uint32_t key, uint32_t hash) {
+    staticMapItem_t *slot = staticMapSlotItem(map, index);
+
+    nodeSetState(slot, STATIC_MAP_SLOT_IN_USE);
+#ifdef STATIC_MAP_STORED_HASH
+    slot->hash = hash;
+#endif
+#ifdef STATIC_MAP_TTL
+    // The struct may still hold the deadline of an earlier occupant
+    slot->deadline = STATIC_MAP_NO_DEADLINE;
+#endif
+    PUBLISH(slot->key, key);
+    ctrlSet(map, index, hash_h2(hash));
+
+    listAddNew(map, slot);
+
+    map->count++;
+    STATS_INC(map, inserts);
+
+    return slot;
+}
+
+/**
+ * Robin Hood insert. The new key takes the first slot whose resident is closer to its home
+ * than the new key is to its own, and the rest of the cluster moves one step down.
+ * Moving is done by rotating pointers in map->items, so the user structs never move.
+ * If the key is already in the map its item is returned and inserted is left false.
+ */
+static staticMapItem_t *insertRobinHood(staticMap_t *map, uint32_t key, uint32_t hash, bool *inserted) {
+    uint32_t index = hash_bucket(map, hash);
+    uint32_t attempt = 0;
+
+    for (; attempt < map->length; attempt++) {
+        staticMapItem_t *slot = staticMapSlotItem(map, index);
+
+        if (staticMapItemState(slot) == STATIC_MAP_SLOT_EMPTY) {
+            *inserted = true;
+            return placeInSlot(map, index, key, hash);
+        }
+        else if (staticMapItemState(slot) == STATIC_MAP_SLOT_IN_USE) {
+            if (KEY_MATCHES(slot, key, hash)) {
+                return slot;
+            }
+
+            if (homeDistance(map, slot, index) < attempt) {
+                // Steal this slot from the richer resident
+                break;
+            }
+        }
+
+        index = LINEAR_PROBE(index, map);
+    }
+
+    if (attempt == map->length) {
+        // Map is full
+        return NULL;
+    }
+
+    // Find the end of the cluster, that is where the free item struct comes from
+    uint32_t free_index = index;
+    for (attempt = 0; attempt < map->length; attempt++) {
+        if (staticMapItemState(staticMapSlotItem(map, free_index)) != STATIC_MAP_SLOT_IN_USE) {
+            break;
+        }
+        free_index = LINEAR_PROBE(free_index, map);
+    }
+
+    if (attempt == map->length) {
+        // Map is full
+        return NULL;
+    }
+
+    // Rotate the free struct back to the insert position, shifting the residents one step
+    while (free_index != index) {
+        uint32_t prev_index = (free_index == 0) ? (uint32_t)(map->length - 1) : free_index - 1;
+        moveSlot(map, prev_index, free_index);
+        free_index = prev_index;
+    }
+
+    *inserted = true;
+    return placeInSlot(map, index, key, hash);
+}
+
+// Linear probing insert using the control bytes, the same probe finds the key and the first free slot
+static staticMapItem_t *insertGroups(staticMap_t *map, uint32_t key, uint32_t hash, bool *inserted) {
+    uint32_t found = 0;
+    uint32_t free  = 0;
+
+    if (probeGroups(map, key, hash, &found, &free) == STATIC_MAP_SUCCESS) {
+        return staticMapSlotItem(map, found);
+    }
+
+    if (free == map->length) {
+        // Map is full
+        return NULL;
+    }
+
+    *inserted = true;
+    return placeInSlot(map, free, key, hash);
+}
+
+// Point the map at a new table and mark every slot empty, map->item_size must be set
+static void initTable(staticMap_t *map, staticMapItem_t **itemsArray, size_t length, staticMapItem_t *first_item, uint8_t *ctrl) {
+    if (ctrl != NULL) {
+        // Every control byte starts out empty, including the mirrored tail
+        memset(ctrl, CTRL_EMPTY, STATIC_MAP_CTRL_BYTES(length));
+    }
+
+    map->items  = itemsArray;   // The user-provided array, NULL for strided maps
+    map->length = length;
+    map->base   = (uint8_t *)first_item;
+    map->mask   = ((length & (length - 1)) == 0) ? (uint32_t)(length - 1) : 0;
+    map->ctrl   = ctrl;
+
+    staticMapItem_t * item = first_item;
+    for (uint32_t i = 0; i < length; i++) {
+        if (itemsArray != NULL) {
+            map->items[i] = item;
+        }
+        item->key     = 0;
+#ifdef STATIC_MAP_STORED_HASH
+        item->hash    = 0;
+#endif
+#ifndef STATIC_MAP_UNORDERED
+        nodeSetNext(map, item, NULL);
+        nodeSetPrev(map, item, NULL);
+#endif
+        nodeSetState(item, STATIC_MAP_SLOT_EMPTY);
+#ifdef STATIC_MAP_TTL
+        item->deadline = STATIC_MAP_NO_DEADLINE;
+#endif
+        item = (staticMapItem_t*)((uint8_t*)item + map->item_size);
+    }
+}
+
+// Shared by the init calls, a NULL items array gives a strided map
+static int32_t initMap(staticMap_t *map, staticMapItem_t **itemsArray, size_t length, size_t item_size, staticMapItem_t *first_item, const staticMapConfig_t *config) {
+    if (map == NULL || length == 0 || item_size < sizeof(staticMapItem_t) || first_item == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    if (length > UINT32_MAX) {
+        // Slot indices are 32-bit
+        return STATIC_MAP_INVALID_CONFIG;
+    }
+
+#if defined(STATIC_MAP_COMPACT_NODE) && !defined(STATIC_MAP_UNORDERED)
+    if (length > STATIC_MAP_MAX_ITEMS) {
+        // Every item must be reachable through a compact link
+        return STATIC_MAP_INVALID_CONFIG;
+    }
+#endif
+
+    staticMapConfig_t defaults = {0};
+    if (config == NULL) {
+        config = &defaults;
+    }
+
+    if (config->probe != STATIC_MAP_PROBE_LINEAR && config->probe != STATIC_MAP_PROBE_ROBIN_HOOD &&
+        config->probe != STATIC_MAP_PROBE_CUCKOO) {
+        return STATIC_MAP_INVALID_CONFIG;
+    }
+
+    if (config->probe == STATIC_MAP_PROBE_CUCKOO && !cuckooConfigValid(length, config->ctrl != NULL, config->concurrent)) {
+        return STATIC_MAP_INVALID_CONFIG;
+    }
+
+    if (config->capacity > length) {
+        return STATIC_MAP_INVALID_CONFIG;
+    }
+
+    if (config->node_offset + sizeof(staticMapItem_t) > item_size) {
+        return STATIC_MAP_INVALID_CONFIG;
+    }
+
+    map->item_size        = item_size;
+    map->node_offset      = config->node_offset;
+    // Only a map set up with a config knows where the node is, unless the items are bare nodes
+    map->node_offset_set  = config != &defaults || item_size == sizeof(staticMapItem_t);
+#ifndef STATIC_MAP_UNORDERED
+    map->head             = NULL;
+    map->tail             = NULL;
+    map->bulk_key         = 0;
+#endif
+    map->probe            = config->probe;
+    map->hash             = config->hash;
+    map->seed             = config->seed;
+    map->count            = 0;
+    map->capacity         = config->capacity ? config->capacity : length;
+    map->evict            = config->evict;
+    map->concurrent       = config->concurrent;
+    map->seq              = 0;
+    map->write_depth      = 0;
+    map->shared           = NULL;
+    map->stashed          = 0;
+    memset(&map->old, 0, sizeof(map->old));
+    memset(&map->frozen, 0, sizeof(map->frozen));
+#ifdef STATIC_MAP_STATS
+    memset(&map->counters, 0, sizeof(map->counters));
+#endif
+
+    initTable(map, itemsArray, length, first_item, config->ctrl);
+
+    return STATIC_MAP_SUCCESS;
+}
+
+int32_t staticMapInit(staticMap_t *map, staticMapItem_t **itemsArray, size_t length, size_t item_size, staticMapItem_t *first_item) {
+    return staticMapInitWithConfig(map, itemsArray, length, item_size, first_item, NULL);
+}
+
+int32_t staticMapInitWithConfig(staticMap_t *map, staticMapItem_t **itemsArray, size_t length, size_t item_size, staticMapItem_t *first_item, const staticMapConfig_t *config) {
+    if (itemsArray == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    return initMap(map, itemsArray, length, item_size, first_item, config);
+}
+
+int32_t staticMapInitStrided(staticMap_t *map, size_t length, size_t item_size, staticMapItem_t *first_item,
+                             size_t node_offset, const staticMapConfig_t *config) {
+    staticMapConfig_t strided_config = {0};
+    if (config != NULL) {
+        strided_config = *config;
+    }
+    strided_config.node_offset = node_offset;
+
+    return initMap(map, NULL, length, item_size, first_item, &strided_config);
+}
+
+static void sharedSync(staticMap_t *map);
+static uint32_t *sharedSeq(const staticMap_t *map);
+static size_t sharedCount(const staticMap_t *map);
+
+// The sequence number lives in the shared region for process shared maps
+static inline uint32_t *seqWord(const staticMap_t *map) {
+    return map->shared != NULL ? sharedSeq(map) : (uint32_t *)&map->seq;
+}
+
+// Seqlock writer side, the sequence number is odd while a change is in progress
+static inline void writeBegin(staticMap_t *map) {
+    if (map->concurrent && map->write_depth++ == 0) {
+        uint32_t *seq = seqWord(map);
+        __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+}
+
+static inline void writeEnd(staticMap_t *map) {
+    if (map->concurrent && --map->write_depth == 0) {
+        if (map->shared != NULL) {
+            sharedSync(map);
+        }
+
+        uint32_t *seq = seqWord(map);
+        __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+    }
+}
+
+// First slot of a cuckoo bucket that is not in use, or map->length
+static inline uint32_t cuckooFree(staticMap_t *map, uint32_t start) {
+    for (uint32_t index = start; index < start + CUCKOO_WAYS; index++) {
+        if (staticMapItemState(staticMapSlotItem(map, index)) != STATIC_MAP_SLOT_IN_USE) {
+            return index;
+        }
+    }
+    return (uint32_t)map->length;
+}
+
+// Entries the search for a cuckoo path may look at
+#define CUCKOO_SEARCH 256
+
+/**
+ * Both buckets of a hash are full. Search breadth first for a chain of entries that can each move
+ * to their other bucket, ending in a free slot, then move them back to front so that a slot in
+ * one of the two buckets is freed. The moves swap pointers in map->items, or copy strided items.
+ * Breadth first gives the shortest chain, so no slot is used twice.
+ * Returns the freed slot, or map->length if no chain was found
+ */
+static uint32_t cuckooMakeRoom(staticMap_t *map, uint32_t hash) {
+    uint32_t slots[CUCKOO_SEARCH];
+    int16_t  parents[CUCKOO_SEARCH];
+    uint32_t tail = 0;
+
+    uint32_t starts[2] = {cuckooFirst(map, hash), cuckooSecond(map, hash)};
+    for (uint32_t bucket = 0; bucket < 2; bucket++) {
+        for (uint32_t way = 0; way < CUCKOO_WAYS; way++) {
+            slots[tail]   = starts[bucket] + way;
+            parents[tail] = -1;
+            tail++;
+        }
+    }
+
+    for (uint32_t head = 0; head < tail; head++) {
+        uint32_t from = slots[head];
+        uint32_t moved_hash = slotHash(map, staticMapSlotItem(map, from));
+
+        // The other bucket of the entry in this slot
+        uint32_t other = cuckooFirst(map, moved_hash);
+        if (other == from - from % CUCKOO_WAYS) {
+            other = cuckooSecond(map, moved_hash);
+        }
+
+        for (uint32_t index = other; index < other + CUCKOO_WAYS; index++) {
+            if (staticMapItemState(staticMapSlotItem(map, index)) != STATIC_MAP_SLOT_IN_USE) {
+                // Walk the chain back, every entry moves one step towards the free slot
+                uint32_t to = index;
+                for (int32_t node = (int32_t)head; node >= 0; node = parents[node]) {
+                    moveSlot(map, slots[node], to);
+                    to = slots[node];
+                }
+                return to;
+            }
+
+            if (tail < CUCKOO_SEARCH) {
+                slots[tail]   = index;
+                parents[tail] = (int16_t)head;
+                tail++;
+            }
+        }
+    }
+
+    return (uint32_t)map->length;
+}
+
+// Cuckoo insert, the key goes to one of its two buckets or, failing that, to the stash
+static staticMapItem_t *insertCuckoo(staticMap_t *map, uint32_t key, uint32_t hash, bool *inserted) {
+    uint32_t index = 0;
+    if (probeFor(map, key, hash, &index) == STATIC_MAP_SUCCESS) {
+        return staticMapSlotItem(map, index);
+    }
+
+    index = cuckooFree(map, cuckooFirst(map, hash));
+    if (index == map->length) {
+        index = cuckooFree(map, cuckooSecond(map, hash));
+    }
+    if (index == map->length) {
+        index = cuckooMakeRoom(map, hash);
+    }
+
+    if (index == map->length) {
+        for (index = cuckooStash(map); index < map->length; index++) {
+            staticMapslotState_t state = staticMapItemState(staticMapSlotItem(map, index));
+            if (state != STATIC_MAP_SLOT_IN_USE) {
+                map->stashed += state == STATIC_MAP_SLOT_EMPTY ? 1 : 0;
+                break;
+            }
+        }
+    }
+
+    if (index == map->length) {
+        // Map is full
+        return NULL;
+    }
+
+    *inserted = true;
+    return placeInSlot(map, index, key, hash);
+}
+
+/**
+ * Find the key or insert it, in one pass over its probe sequence.
+ * Returns the item of the key, inserted tells if it is new. NULL if the map is full
+ */
+static staticMapItem_t *findOrInsertKey(staticMap_t *map, uint32_t key, uint32_t hash, bool *inserted) {
+    *inserted = false;
+
+    if (map->probe == STATIC_MAP_PROBE_ROBIN_HOOD) {
+        return insertRobinHood(map, key, hash, inserted);
+    }
+
+    if (map->probe == STATIC_MAP_PROBE_CUCKOO) {
+        return insertCuckoo(map, key, hash, inserted);
+    }
+
+    if (map->ctrl != NULL) {
+        return insertGroups(map, key, hash, inserted);
+    }
+
+    // Calculate initial bucket
+    uint32_t index = hash_bucket(map, hash);
+    uint32_t free  = (uint32_t)map->length;
+
+    for (uint32_t attempt = 0; attempt < map->length; attempt++) {
+        staticMapItem_t *slot = staticMapSlotItem(map, index);
+
+        if (staticMapItemState(slot) == STATIC_MAP_SLOT_EMPTY) {
+            // End of the probe, reuse the first tombstone on the way if there was one
+            free = (free == map->length) ? index : free;
+            break;
+        }
+        else if (staticMapItemState(slot) == STATIC_MAP_SLOT_DELETED) {
+            // The key may still be further down, remember the slot and keep probing
+            free = (free == map->length) ? index : free;
+        }
+        else if (KEY_MATCHES(slot, key, hash)) {
+            return slot;
+        }
+
+        // Collision: probe the next slot
+        index = LINEAR_PROBE(index, map);
+    }
+
+    if (free == map->length) {
+        // Map is full
+        return NULL;
+    }
+
+    *inserted = true;
+    return placeInSlot(map, free, key, hash);
+}
+
+// Insert a new key, NULL if the key already exists or the map is full
+static staticMapItem_t *insertKey(staticMap_t *map, uint32_t key, uint32_t hash) {
+    bool inserted;
+    staticMapItem_t *slot = findOrInsertKey(map, key, hash, &inserted);
+    return inserted ? slot : NULL;
+}
+
+#define GROWING(map) ((map)->old.length != 0)
+#define FROZEN(map)  ((map)->frozen.entries != NULL)
+
+// Perfect hash buckets and positions, both are mixed again so that weak map hashes still spread
+static inline uint32_t frozenBucket(uint32_t hash, uint32_t buckets) {
+    return fastRange(mix32(hash), buckets);
+}
+
+static inline uint32_t frozenPosition(uint32_t hash, uint32_t disp, uint32_t size) {
+    return fastRange(mix32(hash ^ ((disp + 1) * 0x9e3779b9U)), size);
+}
+
+static inline staticMapItem_t *frozenFind(staticMap_t *map, uint32_t key, uint32_t hash) {
+    const staticMapFrozen_t *frozen = &map->frozen;
+    if (frozen->size == 0) {
+        return NULL;
+    }
+
+    uint32_t disp = frozen->disp[frozenBucket(hash, frozen->buckets)];
+    const staticMapFrozenEntry_t *entry = &frozen->entries[frozenPosition(hash, disp, frozen->size)];
+
+    return entry->key == key ? staticMapSlotItem(map, entry->slot) : NULL;
+}
+
+// A map over the table that a grow is draining, everything but the slots is shared with map
+static inline void oldTable(const staticMap_t *map, staticMap_t *old) {
+    *old = *map;
+    old->items      = map->old.items;
+    old->base       = map->old.base;
+    old->ctrl       = map->old.ctrl;
+    old->length     = map->old.length;
+    old->mask       = map->old.mask;
+    old->count      = map->old.count;
+    old->old.length = 0;
+}
+
+// Take the entry in slot index out of the old table. The slot becomes a tombstone, so the
+// probes of the entries left behind and the migration cursor stay valid
+static void removeOld(staticMap_t *map, staticMap_t *old, uint32_t index) {
+    nodeSetState(staticMapSlotItem(old, index), STATIC_MAP_SLOT_DELETED);
+    ctrlSet(old, index, CTRL_DELETED);
+
+    if (--map->old.count == 0) {
+        // Done, the old storage is the caller's again
+        memset(&map->old, 0, sizeof(map->old));
+    }
+}
+
+// Copy the entry in slot index of the old table into the new one, keeping its place in the list
+static void migrateSlot(staticMap_t *map, staticMap_t *old, uint32_t index) {
+    staticMapItem_t *from = staticMapSlotItem(old, index);
+
+    // Can not fail, inserts stop while the entries of both tables would not fit in the new one
+    staticMapItem_t *to = insertKey(map, from->key, slotHash(old, from));
+    listUnlink(map, to);
+
+    memcpy((uint8_t *)to - map->node_offset, (uint8_t *)from - map->node_offset, map->item_size);
+    listRelink(map, to);
+
+    // placeInSlot counted the entry as a new one
+    map->count--;
+    STATS_DEC(map, inserts);
+
+    removeOld(map, old, index);
+}
+
+static void growStep(staticMap_t *map, uint32_t budget) {
+    if (!GROWING(map)) {
+        return;
+    }
+
+    staticMap_t old;
+    oldTable(map, &old);
+
+    for (; budget > 0 && GROWING(map); budget--) {
+        // Entries are only ever taken out of the old table, the cursor can not pass the last one
+        uint32_t index = map->old.cursor++;
+        if (staticMapItemState(staticMapSlotItem(&old, index)) == STATIC_MAP_SLOT_IN_USE) {
+            migrateSlot(map, &old, index);
+        }
+    }
+}
+
+// Look a key up in both tables while a grow is running
+static staticMapItem_t *lookupKey(staticMap_t *map, uint32_t key, uint32_t hash) {
+    uint32_t index = 0;
+    if (probeFor(map, key, hash, &index) == STATIC_MAP_SUCCESS) {
+        return staticMapSlotItem(map, index);
+    }
+
+    if (GROWING(map)) {
+        staticMap_t old;
+        oldTable(map, &old);
+        if (probeFor(&old, key, hash, &index) == STATIC_MAP_SUCCESS) {
+            return staticMapSlotItem(&old, index);
+        }
+    }
+
+    return NULL;
+}
+
+// Insert that migrates part of the old table first, while a grow is running
+static staticMapItem_t *insertEntry(staticMap_t *map, uint32_t key, uint32_t hash) {
+    if (FROZEN(map)) {
+        return NULL;
+    }
+
+    if (GROWING(map)) {
+        growStep(map, STATIC_MAP_GROW_STEP);
+    }
+
+    if (GROWING(map)) {
+        // Keep room for the entries that have not moved yet
+        if (map->count >= map->length) {
+            return NULL;
+        }
+
+        staticMap_t old;
+        uint32_t index = 0;
+        oldTable(map, &old);
+        if (probeFor(&old, key, hash, &index) == STATIC_MAP_SUCCESS) {
+            // The key is not unique, that is not a valid use case
+            return NULL;
+        }
+    }
+
+    return insertKey(map, key, hash);
+}
+
+// Remove an item from whichever table holds it
+static int32_t removeItem(staticMap_t *map, staticMapItem_t *item) {
+    if (FROZEN(map)) {
+        return STATIC_MAP_FROZEN;
+    }
+
+    uint32_t index = findItemIndex(map, item);
+    if (index != map->length) {
+        removeAt(map, index);
+        return STATIC_MAP_SUCCESS;
+    }
+
+    if (GROWING(map)) {
+        staticMap_t old;
+        oldTable(map, &old);
+        index = findItemIndex(&old, item);
+        if (index != old.length) {
+            listUnlink(map, item);
+            removeOld(map, &old, index);
+
+            map->count--;
+            STATS_INC(map, removes);
+            return STATIC_MAP_SUCCESS;
+        }
+    }
+
+    // The item is marked in use but is not reachable from its key, it does not belong to this map
+    return STATIC_MAP_INVALID_KEY;
+}
+
+// Remove a key from whichever table holds it, returns the result of the probe of the new table on a miss
+static int32_t removeKey(staticMap_t *map, uint32_t key, uint32_t hash) {
+    if (FROZEN(map)) {
+        return STATIC_MAP_FROZEN;
+    }
+
+    uint32_t index = 0;
+    int32_t result = probeFor(map, key, hash, &index);
+    if (result == STATIC_MAP_SUCCESS) {
+        removeAt(map, index);
+        return STATIC_MAP_SUCCESS;
+    }
+
+    staticMapItem_t *item = GROWING(map) ? lookupKey(map, key, hash) : NULL;
+    if (item != NULL) {
+        return removeItem(map, item);
+    }
+
+    return result;
+}
+
+staticMapItem_t *staticMapInsertAndGet(staticMap_t *map, uint32_t key) {
+    if (map == NULL) {
+        return NULL;
+    }
+
+    return staticMapInsertAndGetHashed(map, key, hash_key(map, key));
+}
+
+staticMapItem_t *staticMapInsertAndGetHashed(staticMap_t *map, uint32_t key, uint32_t hash) {
+    if (map == NULL) {
+        return NULL;
+    }
+
+    writeBegin(map);
+    staticMapItem_t *slot = insertEntry(map, key, hash);
+    writeEnd(map);
+
+    if (slot == NULL) {
+        STATS_INC(map, insert_failures);
+    }
+
+    return slot;
+}
+
+int32_t staticMapFindOrInsert(staticMap_t *map, uint32_t key, staticMapItem_t **item) {
+    if (map == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    return staticMapFindOrInsertHashed(map, key, hash_key(map, key), item);
+}
+
+int32_t staticMapFindOrInsertHashed(staticMap_t *map, uint32_t key, uint32_t hash, staticMapItem_t **item) {
+    if (map == NULL || item == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    bool inserted = false;
+    staticMapItem_t *slot;
+
+    if (FROZEN(map)) {
+        // Nothing can be inserted, but a hit is still a hit
+        slot = frozenFind(map, key, hash);
+    } else if (GROWING(map)) {
+        // The key may sit in either table, the grow path can not do it in one pass
+        writeBegin(map);
+        slot = lookupKey(map, key, hash);
+        if (slot == NULL) {
+            slot = insertEntry(map, key, hash);
+            inserted = slot != NULL;
+        }
+        writeEnd(map);
+    } else {
+        writeBegin(map);
+        slot = findOrInsertKey(map, key, hash, &inserted);
+        writeEnd(map);
+    }
+
+    *item = slot;
+    if (slot == NULL) {
+        STATS_INC(map, insert_failures);
+        return FROZEN(map) ? STATIC_MAP_FROZEN : STATIC_MAP_FULL;
+    }
+
+    return inserted ? 1 : 0;
+}
+
+staticMapItem_t* staticMapFind(staticMap_t *map, uint32_t key) {
+    if (map == NULL) {
+        return NULL;
+    }
+
+    return staticMapFindHashed(map, key, hash_key(map, key));
+}
+
+staticMapItem_t *staticMapFindHashed(staticMap_t *map, uint32_t key, uint32_t hash) {
+    if (map == NULL) {
+        return NULL;
+    }
+
+    STATS_INC(map, lookups);
+
+    staticMapItem_t *slot;
+    if (FROZEN(map)) {
+        STATS_PROBE(map, 1);
+        slot = frozenFind(map, key, hash);
+    } else {
+        slot = lookupKey(map, key, hash);
+    }
+
+    if (slot == NULL) {
+        STATS_INC(map, lookup_misses);
+        return NULL; // Not found
+    }
+
+    return slot;
+}
+
+int32_t staticMapRemove(staticMap_t *map, staticMapItem_t *item) {
+    if (map == NULL || item == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    // Check if this item is in use
+    if (staticMapItemState(item) != STATIC_MAP_SLOT_IN_USE) {
+        // This is not good, it means that a pointer to an item is used after remove
+        // this is similar to use after free, or double free
+        return STATIC_MAP_UNUSED_ERASE;
+    }
+
+    writeBegin(map);
+    int32_t result = removeItem(map, item);
+    if (result == STATIC_MAP_SUCCESS) {
+        growStep(map, STATIC_MAP_GROW_STEP);
+    }
+    writeEnd(map);
+
+    return result;
+}
+
+int32_t staticMapRemoveByKey(staticMap_t *map, uint32_t key) {
+    if (map == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    return staticMapRemoveByKeyHashed(map, key, hash_key(map, key));
+}
+
+int32_t staticMapRemoveByKeyHashed(staticMap_t *map, uint32_t key, uint32_t hash) {
+    if (map == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    writeBegin(map);
+    int32_t result = removeKey(map, key, hash);
+    if (result == STATIC_MAP_SUCCESS) {
+        growStep(map, STATIC_MAP_GROW_STEP);
+    }
+    writeEnd(map);
+
+    return result;
+}
+
+#ifndef STATIC_MAP_UNORDERED
+staticMapItem_t *staticMapFindAndTouch(staticMap_t *map, uint32_t key) {
+    staticMapItem_t *slot = staticMapFind(map, key);
+
+    if (slot != NULL && slot != map->head) {
+        // Move to the HEAD (newest), the tail is always the least recently used
+        listUnlink(map, slot);
+        listPushHead(map, slot);
+
+        if (map->shared != NULL) {
+            sharedSync(map);
+        }
+    }
+
+    return slot;
+}
+
+/**
+ * Remove an item for eviction or expiry. The eviction callback is called once the item has been
+ * found, when the removal can no longer fail, and before a strided map overwrites its struct.
+ * hole is set to the slot that holds the freed struct in the new table, map->length otherwise
+ */
+static int32_t evictItem(staticMap_t *map, staticMapItem_t *oldest, uint32_t *hole) {
+    uint32_t index = findItemIndex(map, oldest);
+    *hole = (uint32_t)map->length;
+
+    if (index != map->length) {
+        if (map->evict != NULL) {
+            map->evict(map, oldest);
+        }
+
+        writeBegin(map);
+        *hole = removeAt(map, index);
+        writeEnd(map);
+        STATS_INC(map, evictions);
+        return STATIC_MAP_SUCCESS;
+    }
+
+    // Not migrated yet, removeItem takes it out of the old table without moving anything
+    staticMap_t old;
+    oldTable(map, &old);
+    if (!GROWING(map) || findItemIndex(&old, oldest) == old.length) {
+        return STATIC_MAP_INVALID_KEY;
+    }
+
+    if (map->evict != NULL) {
+        map->evict(map, oldest);
+    }
+
+    writeBegin(map);
+    int32_t result = removeItem(map, oldest);
+    writeEnd(map);
+    STATS_INC(map, evictions);
+
+    return result;
+}
+
+/**
+ * Let the entry that was just inserted take over the free struct in slot hole, so the struct of
+ * an evicted item is used again. The struct the entry had is free afterwards.
+ * Only maps with an items array can move an entry to another struct
+ */
+static staticMapItem_t *adoptStruct(staticMap_t *map, staticMapItem_t *entry, uint32_t hole) {
+    uint32_t index = findItemIndex(map, entry);
+    staticMapItem_t *spare = map->items[hole];
+
+    writeBegin(map);
+    listUnlink(map, entry);
+    spare->key = entry->key;
+#ifdef STATIC_MAP_STORED_HASH
+    spare->hash = entry->hash;
+#endif
+#ifdef STATIC_MAP_TTL
+    spare->deadline = STATIC_MAP_NO_DEADLINE;
+#endif
+    nodeSetState(spare, STATIC_MAP_SLOT_IN_USE);
+    listPushHead(map, spare);
+    nodeSetState(entry, STATIC_MAP_SLOT_EMPTY);
+
+    PUBLISH(map->items[index], spare);
+    PUBLISH(map->items[hole], entry);
+    writeEnd(map);
+
+    return spare;
+}
+
+staticMapItem_t *staticMapInsertOrEvict(staticMap_t *map, uint32_t key) {
+    if (map == NULL) {
+        return NULL;
+    }
+
+    if (FROZEN(map)) {
+        STATS_INC(map, insert_failures);
+        return NULL;
+    }
+
+    uint32_t hash = hash_key(map, key);
+    uint32_t hole = 0;
+    staticMapItem_t *slot = NULL;
+
+    if (map->count >= map->capacity && GROWING(map)) {
+        // Both tables have to be checked for the key before anything is evicted
+        if (lookupKey(map, key, hash) != NULL || evictItem(map, map->tail, &hole) != STATIC_MAP_SUCCESS) {
+            STATS_INC(map, insert_failures);
+            return NULL;
+        }
+    }
+
+    if (map->count < map->capacity) {
+        writeBegin(map);
+        slot = insertEntry(map, key, hash);
+        writeEnd(map);
+
+        if (slot == NULL) {
+            STATS_INC(map, insert_failures);
+        }
+        return slot;
+    }
+
+    // One probe finds a duplicate or places the key, there are free slots past the capacity
+    bool inserted = false;
+    writeBegin(map);
+    slot = findOrInsertKey(map, key, hash, &inserted);
+    writeEnd(map);
+
+    if (slot != NULL && !inserted) {
+        // The key is not unique, nothing is evicted
+        STATS_INC(map, insert_failures);
+        return NULL;
+    }
+
+    if (slot == NULL) {
+        // No free slot, the probe did not find the key so evict first. The freed struct
+        // is the only free one, the insert takes it
+        if (evictItem(map, map->tail, &hole) != STATIC_MAP_SUCCESS) {
+            STATS_INC(map, insert_failures);
+            return NULL;
+        }
+
+        writeBegin(map);
+        slot = insertKey(map, key, hash);
+        writeEnd(map);
+
+        if (slot == NULL) {
+            STATS_INC(map, insert_failures);
+        }
+        return slot;
+    }
+
+    if (evictItem(map, map->tail, &hole) != STATIC_MAP_SUCCESS) {
+        // The tail is not reachable from its key, take the new entry out again
+        writeBegin(map);
+        removeItem(map, slot);
+        writeEnd(map);
+        STATS_INC(map, insert_failures);
+        return NULL;
+    }
+
+    if (map->items != NULL) {
+        return adoptStruct(map, slot, hole);
+    }
+
+    // The removal may have copied the new entry of a strided map to another slot
+    if (staticMapItemState(slot) != STATIC_MAP_SLOT_IN_USE || slot->key != key) {
+        slot = lookupKey(map, key, hash);
+    }
+
+    return slot;
+}
+#endif
+
+#ifdef STATIC_MAP_TTL
+// True once now has reached the deadline, correct across a wrap of the 32-bit clock
+static inline bool deadlinePassed(uint32_t deadline, uint32_t now) {
+    return (int32_t)(now - deadline) >= 0;
+}
+
+int32_t staticMapSetDeadline(staticMap_t *map, staticMapItem_t *item, uint32_t deadline) {
+    if (map == NULL || item == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    if (staticMapItemState(item) != STATIC_MAP_SLOT_IN_USE) {
+        return STATIC_MAP_UNUSED_ERASE;
+    }
+
+    item->deadline = deadline;
+
+    // The newest deadline goes to the head, so the tail is always the first to expire
+    if (item != map->head) {
+        listUnlink(map, item);
+        listPushHead(map, item);
+
+        if (map->shared != NULL) {
+            sharedSync(map);
+        }
+    }
+
+    return STATIC_MAP_SUCCESS;
+}
+
+int32_t staticMapExpire(staticMap_t *map, uint32_t now, uint32_t budget, uint32_t *next_deadline) {
+    if (map == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    if (FROZEN(map)) {
+        return STATIC_MAP_FROZEN;
+    }
+
+    int32_t expired = 0;
+    staticMapItem_t *item = map->tail;
+    while (item != NULL) {
+        // Items without a deadline never expire, step over them and leave them where they are
+        if (item->deadline == STATIC_MAP_NO_DEADLINE) {
+            item = staticMapItemNext(map, item);
+            continue;
+        }
+
+        if (budget == 0 || !deadlinePassed(item->deadline, now)) {
+            break;
+        }
+
+        staticMapItem_t *next = staticMapItemNext(map, item);
+        uint32_t next_key = next != NULL ? next->key : 0;
+        uint32_t next_hash = next != NULL ? slotHash(map, next) : 0;
+
+        uint32_t hole = 0;
+        int32_t result = evictItem(map, item, &hole);
+        if (result != STATIC_MAP_SUCCESS) {
+            return result;
+        }
+
+        // A strided map may have shifted the next item into another slot
+        if (next != NULL && (staticMapItemState(next) != STATIC_MAP_SLOT_IN_USE || next->key != next_key)) {
+            next = lookupKey(map, next_key, next_hash);
+        }
+
+        item = next;
+        expired++;
+        budget--;
+    }
+
+    if (next_deadline != NULL && item != NULL) {
+        *next_deadline = item->deadline;
+    }
+
+    return expired;
+}
+#endif
+
+uint32_t staticMapReadBegin(const staticMap_t *map) {
+    const uint32_t *word = seqWord(map);
+    uint32_t seq = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+
+    // An odd sequence number means a change is in progress
+    while (seq & 1) {
+        seq = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+    }
+
+    return seq;
+}
+
+bool staticMapReadRetry(const staticMap_t *map, uint32_t seq) {
+    // Keep the reads of the section from moving below the sequence check
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(seqWord(map), __ATOMIC_RELAXED) != seq;
+}
+
+staticMapItem_t *staticMapFindConcurrent(const staticMap_t *map, uint32_t key) {
+    if (map == NULL) {
+        return NULL;
+    }
+
+    return staticMapFindConcurrentHashed(map, key, hash_key(map, key));
+}
+
+staticMapItem_t *staticMapFindConcurrentHashed(const staticMap_t *map, uint32_t key, uint32_t hash) {
+    if (map == NULL) {
+        return NULL;
+    }
+
+    // Plain slot walk, valid for every probing scheme. The loads are atomic so a reader never
+    // sees half a pointer, a mix of old and new values is caught by staticMapReadRetry.
+    // The walk is bounded by the length so a torn view can not make it spin
+    uint32_t index = hash_bucket(map, hash);
+
+    for (uint32_t attempt = 0; attempt < map->length; attempt++) {
+        staticMapItem_t *slot = map->items != NULL ? __atomic_load_n(&map->items[index], __ATOMIC_RELAXED)
+                                                   : staticMapSlotItem(map, index);
+        staticMapslotState_t state = nodeStateAtomic(slot);
+
+        if (state == STATIC_MAP_SLOT_EMPTY) {
+            return NULL;
+        }
+
+        if (state == STATIC_MAP_SLOT_IN_USE && __atomic_load_n(&slot->key, __ATOMIC_RELAXED) == key) {
+            return slot;
+        }
+
+        index = LINEAR_PROBE(index, map);
+    }
+
+    return NULL;
+}
+
+void staticMapWriteBegin(staticMap_t *map) {
+    if (map != NULL) {
+        writeBegin(map);
+    }
+}
+
+void staticMapWriteEnd(staticMap_t *map) {
+    if (map != NULL) {
+        writeEnd(map);
+    }
+}
+
+int32_t staticMapFindBatch(staticMap_t *map, const uint32_t *keys, size_t n, staticMapItem_t **out_items) {
+    if (map == NULL || keys == NULL || out_items == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    int32_t found_items = 0;
+    probeState_t probes[BATCH_CHUNK];
+    uint8_t active[BATCH_CHUNK];
+
+    if (FROZEN(map)) {
+        // Every lookup is a single read already, nothing to interleave
+        for (size_t i = 0; i < n; i++) {
+            out_items[i] = staticMapFind(map, keys[i]);
+            found_items += out_items[i] != NULL;
+        }
+        return found_items;
+    }
+
+    for (size_t base = 0; base < n; base += BATCH_CHUNK) {
+        size_t chunk = (n - base < BATCH_CHUNK) ? n - base : BATCH_CHUNK;
+
+        // Hash every key first and start loading the first slot of each probe
+        for (size_t i = 0; i < chunk; i++) {
+            probeStart(map, &probes[i], keys[base + i], hash_key(map, keys[base + i]));
+            probePrefetch(map, &probes[i]);
+            active[i] = (uint8_t)i;
+        }
+
+        // The slot pointers should be arriving by now, start loading the items they point to
+        if (map->ctrl == NULL && map->items != NULL) {
+            for (size_t i = 0; i < chunk; i++) {
+                PREFETCH(map->items[probes[i].index]);
+            }
+        }
+
+        // Advance the probes round robin, a probe that needs another step prefetches it
+        // and waits for the rest of the chunk, so the cache misses overlap
+        size_t num_active = chunk;
+        while (num_active > 0) {
+            size_t still_active = 0;
+
+            for (size_t j = 0; j < num_active; j++) {
+                probeState_t *probe = &probes[active[j]];
+                uint32_t index = 0;
+                int32_t result = probeStep(map, probe, &index);
+
+                if (result == PROBE_CONTINUE) {
+                    probePrefetch(map, probe);
+                    active[still_active++] = active[j];
+                    continue;
+                }
+
+                STATS_INC(map, lookups);
+                STATS_PROBE(map, probe->attempt);
+
+                if (result == STATIC_MAP_SUCCESS) {
+                    out_items[base + active[j]] = staticMapSlotItem(map, index);
+                    found_items++;
+                } else if (GROWING(map)) {
+                    // Not moved yet, look in the old table
+                    out_items[base + active[j]] = lookupKey(map, probe->key, probe->hash);
+                    if (out_items[base + active[j]] != NULL) {
+                        found_items++;
+                    } else {
+                        STATS_INC(map, lookup_misses);
+                    }
+                } else {
+                    out_items[base + active[j]] = NULL;
+                    STATS_INC(map, lookup_misses);
+                }
+            }
+
+            num_active = still_active;
+        }
+    }
+
+    return found_items;
+}
+
+// Hash a chunk of keys and prefetch the home slot of each, used by the batch calls that modify the map
+static void batchPrepare(staticMap_t *map, const uint32_t *keys, size_t chunk, uint32_t *hashes) {
+    for (size_t i = 0; i < chunk; i++) {
+        hashes[i] = hash_key(map, keys[i]);
+
+        if (map->ctrl != NULL) {
+            PREFETCH(&map->ctrl[hash_bucket(map, hashes[i])]);
+        } else if (map->items != NULL) {
+            PREFETCH(&map->items[hash_bucket(map, hashes[i])]);
+        } else {
+            PREFETCH(staticMapSlotItem(map, hash_bucket(map, hashes[i])));
+        }
+    }
+
+    if (map->ctrl == NULL && map->items != NULL) {
+        for (size_t i = 0; i < chunk; i++) {
+            PREFETCH(map->items[hash_bucket(map, hashes[i])]);
+        }
+    }
+}
+
+int32_t staticMapInsertBatch(staticMap_t *map, const uint32_t *keys, size_t n, staticMapItem_t **out_items) {
+    if (map == NULL || keys == NULL || out_items == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    int32_t inserted = 0;
+    uint32_t hashes[BATCH_CHUNK];
+
+    for (size_t base = 0; base < n; base += BATCH_CHUNK) {
+        size_t chunk = (n - base < BATCH_CHUNK) ? n - base : BATCH_CHUNK;
+
+        batchPrepare(map, &keys[base], chunk, hashes);
+
+        // Inserts change the map, so they run in order once the lines are on their way
+        writeBegin(map);
+        for (size_t i = 0; i < chunk; i++) {
+            staticMapItem_t *slot = insertEntry(map, keys[base + i], hashes[i]);
+            out_items[base + i] = slot;
+
+            if (slot != NULL) {
+                inserted++;
+            } else {
+                STATS_INC(map, insert_failures);
+            }
+        }
+        writeEnd(map);
+    }
+
+    return inserted;
+}
+
+int32_t staticMapRemoveBatch(staticMap_t *map, const uint32_t *keys, size_t n) {
+    if (map == NULL || keys == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    int32_t removed = 0;
+    uint32_t hashes[BATCH_CHUNK];
+
+    for (size_t base = 0; base < n; base += BATCH_CHUNK) {
+        size_t chunk = (n - base < BATCH_CHUNK) ? n - base : BATCH_CHUNK;
+
+        batchPrepare(map, &keys[base], chunk, hashes);
+
+        writeBegin(map);
+        for (size_t i = 0; i < chunk; i++) {
+            if (removeKey(map, keys[base + i], hashes[i]) == STATIC_MAP_SUCCESS) {
+                removed++;
+            }
+        }
+        writeEnd(map);
+    }
+
+    return removed;
+}
+
+// Bulk inserts sort the keys into this many ranges of home buckets
+#define BULK_BINS 256
+
+#ifndef STATIC_MAP_UNORDERED
+// Link the new items of a bulk insert behind the current head, in placement order
+static void bulkLink(staticMap_t *map, const uint32_t *order, size_t n, staticMapItem_t **out_items) {
+    staticMapItem_t *last = map->head;
+
+    for (size_t i = 0; i < n; i++) {
+        staticMapItem_t *item = out_items[order[i]];
+        if (item == NULL) {
+            continue;
+        }
+
+        nodeSetPrev(map, item, last);
+        if (last != NULL) {
+            nodeSetNext(map, last, item);
+        } else {
+            map->tail = item;
+        }
+        last = item;
+    }
+
+    if (last != map->head) {
+        nodeSetNext(map, last, NULL);
+        map->head = last;
+    }
+}
+#endif
+
+int32_t staticMapBulkInsert(staticMap_t *map, const uint32_t *keys, size_t n, staticMapItem_t **out_items, uint32_t *scratch) {
+    if (map == NULL || (n > 0 && (keys == NULL || out_items == NULL || scratch == NULL))) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    if (FROZEN(map)) {
+        return STATIC_MAP_FROZEN;
+    }
+
+    if (n > map->length - map->count) {
+        return STATIC_MAP_FULL;
+    }
+
+    uint32_t *hashes = scratch;
+    uint32_t *order  = scratch + n;
+
+    uint32_t bins[BULK_BINS + 1] = {0};
+    for (size_t i = 0; i < n; i++) {
+        hashes[i] = hash_key(map, keys[i]);
+        bins[(uint64_t)hash_bucket(map, hashes[i]) * BULK_BINS / map->length + 1]++;
+    }
+
+    for (uint32_t bin = 0; bin < BULK_BINS; bin++) {
+        bins[bin + 1] += bins[bin];
+    }
+
+    // Counting sort, within a bin the keys keep their order
+    for (size_t i = 0; i < n; i++) {
+        order[bins[(uint64_t)hash_bucket(map, hashes[i]) * BULK_BINS / map->length]++] = (uint32_t)i;
+    }
+
+    int32_t inserted = 0;
+    bool full = false;
+
+    writeBegin(map);
+
+    // Migration links the entries it moves one by one, it can not run between the placements
+    growStep(map, UINT32_MAX);
+
+    for (size_t i = 0; i < n; i++) {
+        uint32_t key_index = order[i];
+        bool is_new = false;
+
+#ifndef STATIC_MAP_UNORDERED
+        map->bulk_key = (size_t)key_index + 1;
+#endif
+        staticMapItem_t *slot = findOrInsertKey(map, keys[key_index], hashes[key_index], &is_new);
+        out_items[key_index] = is_new ? slot : NULL;
+
+        if (is_new) {
+            inserted++;
+        } else {
+            // A duplicate, or a cuckoo map that found no room
+            full = full || slot == NULL;
+            STATS_INC(map, insert_failures);
+        }
+    }
+
+    if (map->items == NULL && map->probe != STATIC_MAP_PROBE_LINEAR) {
+#ifdef STATIC_MAP_UNORDERED
+        // Placement copies strided items along and unordered nodes can not carry their key
+        // index, look the items up again
+        for (size_t i = 0; i < n; i++) {
+            uint32_t key_index = order[i];
+            if (out_items[key_index] != NULL) {
+                out_items[key_index] = lookupKey(map, keys[key_index], hashes[key_index]);
+            }
+        }
+#else
+        // Placement copies strided items along, every new item carries the index of its key
+        for (uint32_t index = 0; index < map->length; index++) {
+            staticMapItem_t *slot = staticMapSlotItem(map, index);
+            if (staticMapItemState(slot) == STATIC_MAP_SLOT_IN_USE && nodePending(map, slot)) {
+                out_items[nodePendingKey(slot)] = slot;
+            }
+        }
+#endif
+    }
+
+#ifndef STATIC_MAP_UNORDERED
+    map->bulk_key = 0;
+    bulkLink(map, order, n, out_items);
+#endif
+    writeEnd(map);
+
+    return full ? STATIC_MAP_FULL : inserted;
+}
+
+int32_t staticMapBuildFrom(staticMap_t *map, const uint32_t *keys, size_t n, staticMapItem_t **out_items, uint32_t *scratch) {
+    if (map == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    if (map->count != 0) {
+        return STATIC_MAP_INVALID_CONFIG;
+    }
 
-// A simple hash for an 32-bit key. 
-// Could be improved with more sofisticated algo if needed
-static inline uint32_t hash_func(staticMap_t *map, uint32_t key) {
-    return key % map->length;
+    return staticMapBulkInsert(map, keys, n, out_items, scratch);
 }
 
-int32_t staticMapInit(staticMap_t *map, staticMapItem_t **itemsArray, size_t length, size_t item_size, staticMapItem_t *first_item) {
-    if (map == NULL || itemsArray == NULL || length == 0 || item_size < sizeof(staticMapItem_t) || first_item == NULL) {
+int32_t staticMapCompact(staticMap_t *map) {
+    if (map == NULL) {
         return STATIC_MAP_NULL_ERROR;
     }
 
-    map->items            = itemsArray;   // The user-provided array
-    map->length           = length;
-    map->head             = NULL;
-    map->tail             = NULL;
+    if (FROZEN(map)) {
+        return STATIC_MAP_FROZEN;
+    }
 
-    staticMapItem_t * item = first_item;
-    for (uint32_t i = 0; i < length; i++) {
-        map->items[i] = item;
-        item->key     = 0;
-        item->state   = STATIC_MAP_SLOT_EMPTY;
-        item->next    = NULL;
-        item->prev    = NULL;
-        item = (staticMapItem_t*)((uint8_t*)item + item_size);
+    // Reclaim every tombstone, each one is turned into a hole and closed with a backward shift
+    writeBegin(map);
+    for (uint32_t index = 0; index < map->length; index++) {
+        if (staticMapItemState(staticMapSlotItem(map, index)) == STATIC_MAP_SLOT_DELETED) {
+            backwardShift(map, index);
+        }
     }
+    writeEnd(map);
 
     return STATIC_MAP_SUCCESS;
 }
 
-staticMapItem_t *staticMapInsertAndGet(staticMap_t *map, uint32_t key) {
+// Buffer layout of a frozen map: entries, displacements, then the scratch used while building
+static size_t frozenLayout(size_t keys, uint32_t *buckets) {
+    // About four keys per bucket keeps the displacement search short
+    *buckets = (uint32_t)(keys / 4 + 1);
+
+    return keys * sizeof(staticMapFrozenEntry_t) + (size_t)*buckets * sizeof(uint32_t) +
+           ((size_t)*buckets + 1) * sizeof(uint32_t) + 2 * keys * sizeof(uint32_t);
+}
+
+size_t staticMapFreezeSize(const staticMap_t *map) {
     if (map == NULL) {
-        return NULL;
+        return 0;
     }
 
-    // Calculate initial bucket
-    uint32_t index = hash_func(map, key);
-
-    for (uint32_t attempt = 0; attempt < map->length; attempt++) {
-        staticMapItem_t *slot = map->items[index];
+    uint32_t buckets;
+    return frozenLayout(map->count, &buckets);
+}
 
-        if (slot->state == STATIC_MAP_SLOT_EMPTY || slot->state == STATIC_MAP_SLOT_DELETED) {
-            // Found an empty or tombstoned slot, use it
-            slot->state  = STATIC_MAP_SLOT_IN_USE;
-            slot->key = key;
+/**
+ * Find a displacement that puts every key of a bucket on a free position.
+ * The keys are members begin..end-1 of the slot and hash scratch arrays
+ */
+static bool frozenPlace(staticMap_t *map, staticMapFrozen_t *frozen, const uint32_t *slots, const uint32_t *hashes,
+                        uint32_t begin, uint32_t end, uint32_t bucket) {
+    // Equal hashes share a bucket and every position, no displacement can separate them
+    for (uint32_t a = begin; a < end; a++) {
+        for (uint32_t b = a + 1; b < end; b++) {
+            if (hashes[a] == hashes[b]) {
+                return false;
+            }
+        }
+    }
 
-            // Insert at the HEAD (newest)
-            slot->prev = map->head;
-            slot->next = NULL;
+    // The last keys are placed with few positions left, that can take about size tries
+    for (uint32_t disp = 0; disp < UINT32_MAX; disp++) {
+        uint32_t member = begin;
 
-            if (map->head) {
-                map->head->next = slot;
+        for (; member < end; member++) {
+            staticMapFrozenEntry_t *entry = &frozen->entries[frozenPosition(hashes[member], disp, frozen->size)];
+            if (entry->slot != UINT32_MAX) {
+                break;
             }
+            entry->key  = staticMapSlotItem(map, slots[member])->key;
+            entry->slot = slots[member];
+        }
 
-            map->head = slot;
+        if (member == end) {
+            frozen->disp[bucket] = disp;
+            return true;
+        }
 
-            // If there was no tail, this is also the tail (oldest)
-            if (!map->tail) {
-                map->tail = slot;
-            }
+        // Take back the keys placed with this displacement
+        while (member-- > begin) {
+            frozen->entries[frozenPosition(hashes[member], disp, frozen->size)].slot = UINT32_MAX;
+        }
+    }
 
-            return slot;
+    return false;
+}
+
+int32_t staticMapFreeze(staticMap_t *map, void *buffer, size_t size) {
+    if (map == NULL || buffer == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    if (GROWING(map) || map->count > UINT32_MAX / 2 || ((uintptr_t)buffer & 3) != 0) {
+        return STATIC_MAP_INVALID_CONFIG;
+    }
+
+    // The buffer may be the one in use, the map stays unfrozen if this fails
+    memset(&map->frozen, 0, sizeof(map->frozen));
+
+    uint32_t buckets;
+    uint32_t keys = (uint32_t)map->count;
+    if (size < frozenLayout(keys, &buckets)) {
+        return STATIC_MAP_FULL;
+    }
+
+    staticMapFrozenEntry_t *frozen_entries = (staticMapFrozenEntry_t *)buffer;
+    staticMapFrozen_t frozen = {
+        .entries = frozen_entries,
+        .disp    = (uint32_t *)(frozen_entries + keys),
+        .size    = keys,
+        .buckets = buckets,
+    };
+
+    // Scratch: bucket ends, then the slot and hash of every key grouped by bucket
+    uint32_t *ends   = frozen.disp + buckets;
+    uint32_t *slots  = ends + buckets + 1;
+    uint32_t *hashes = slots + keys;
+
+    memset(ends, 0, ((size_t)buckets + 1) * sizeof(uint32_t));
+    for (uint32_t index = 0; index < map->length; index++) {
+        staticMapItem_t *slot = staticMapSlotItem(map, index);
+        if (staticMapItemState(slot) == STATIC_MAP_SLOT_IN_USE) {
+            ends[frozenBucket(slotHash(map, slot), buckets) + 1]++;
         }
-        else if (slot->state == STATIC_MAP_SLOT_IN_USE && slot->key == key) {
-            // The key is not unique, that is not a valid use case
-            return NULL;
+    }
+
+    uint32_t max_members = 0;
+    for (uint32_t bucket = 0; bucket < buckets; bucket++) {
+        if (ends[bucket + 1] > max_members) {
+            max_members = ends[bucket + 1];
         }
+        ends[bucket + 1] += ends[bucket];
+    }
 
-        // Collision: probe the next slot
-        index = LINEAR_PROBE(index, map->length);
+    // Counting sort, afterwards ends[b] is where bucket b stops and bucket b + 1 starts
+    for (uint32_t index = 0; index < map->length; index++) {
+        staticMapItem_t *slot = staticMapSlotItem(map, index);
+        if (staticMapItemState(slot) == STATIC_MAP_SLOT_IN_USE) {
+            uint32_t hash   = slotHash(map, slot);
+            uint32_t member = ends[frozenBucket(hash, buckets)]++;
+            slots[member]   = index;
+            hashes[member]  = hash;
+        }
     }
 
-    // Map is full
-    return NULL;
+    for (uint32_t position = 0; position < keys; position++) {
+        frozen.entries[position].slot = UINT32_MAX;
+    }
+
+    // Place the largest buckets first, while most positions are still free
+    for (uint32_t num_members = max_members; num_members > 0; num_members--) {
+        for (uint32_t bucket = 0; bucket < buckets; bucket++) {
+            uint32_t begin = bucket ? ends[bucket - 1] : 0;
+            if (ends[bucket] - begin != num_members) {
+                continue;
+            }
+
+            if (!frozenPlace(map, &frozen, slots, hashes, begin, ends[bucket], bucket)) {
+                // Keys with the same hash can never be told apart
+                return STATIC_MAP_INVALID_KEY;
+            }
+        }
+    }
+
+    map->frozen = frozen;
+    return STATIC_MAP_SUCCESS;
 }
 
-staticMapItem_t* staticMapFind(staticMap_t *map, uint32_t key) {
+int32_t staticMapUnfreeze(staticMap_t *map) {
     if (map == NULL) {
-        return NULL;
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    memset(&map->frozen, 0, sizeof(map->frozen));
+    return STATIC_MAP_SUCCESS;
+}
+
+int32_t staticMapGrowBegin(staticMap_t *map, staticMapItem_t **new_items, size_t new_length,
+                           staticMapItem_t *new_first_item, uint8_t *new_ctrl) {
+    if (map == NULL || new_first_item == NULL) {
+        return STATIC_MAP_NULL_ERROR;
     }
 
-    uint32_t index = hash_func(map, key);
+    if (FROZEN(map)) {
+        return STATIC_MAP_FROZEN;
+    }
 
-    for (uint32_t attempt = 0; attempt < map->length; attempt++) {
-        staticMapItem_t *slot = map->items[index];
+#if defined(STATIC_MAP_COMPACT_NODE) || defined(STATIC_MAP_UNORDERED)
+    // Index links can not point into two tables, and an unordered map is iterated by slot
+    (void)new_items;
+    (void)new_length;
+    (void)new_ctrl;
+    return STATIC_MAP_INVALID_CONFIG;
+#else
+    if (GROWING(map) || map->concurrent || map->shared != NULL || map->probe == STATIC_MAP_PROBE_CUCKOO ||
+        !map->node_offset_set || new_length <= map->length || new_length > UINT32_MAX) {
+        return STATIC_MAP_INVALID_CONFIG;
+    }
 
-        if (slot->state == STATIC_MAP_SLOT_EMPTY) {
-            // We hit an empty slot, means the key is not in the table
-            return NULL;
-        }
-        else if (slot->state == STATIC_MAP_SLOT_IN_USE && slot->key == key) {
-            // Found it
-            return slot;
-        }
-        // else tombstone or different key => keep probing
-        index = LINEAR_PROBE(index, map->length);
+    map->old.items  = map->items;
+    map->old.base   = map->base;
+    map->old.ctrl   = map->ctrl;
+    map->old.length = map->count != 0 ? map->length : 0;
+    map->old.mask   = map->mask;
+    map->old.count  = map->count;
+    map->old.cursor = 0;
+
+    if (map->capacity == map->length) {
+        map->capacity = new_length;
     }
 
-    return NULL; // Not found
+    // The list keeps running through the old items until they have moved
+    initTable(map, new_items, new_length, new_first_item, new_ctrl);
+
+    return STATIC_MAP_SUCCESS;
+#endif
 }
 
-int32_t staticMapRemove(staticMap_t *map, staticMapItem_t *item) {
-    if (map == NULL || item == NULL) {
+int32_t staticMapGrowStep(staticMap_t *map, uint32_t budget) {
+    if (map == NULL) {
         return STATIC_MAP_NULL_ERROR;
     }
 
-    // Check if this item is in use
-    if (item->state != STATIC_MAP_SLOT_IN_USE) {
-        // This is not good, it means that a pointer to an item is used after remove
-        // this is similar to use after free, or double free
-        return STATIC_MAP_UNUSED_ERASE;
+    writeBegin(map);
+    growStep(map, budget);
+    writeEnd(map);
+
+    return (int32_t)map->old.count;
+}
+
+int32_t staticMapIterErase(staticMapIter_t *iter) {
+    if (iter == NULL || iter->item == NULL) {
+        return STATIC_MAP_NULL_ERROR;
     }
 
-    // Unlink from the active list
-    if (item->prev) {
-        item->prev->next = item->next;
-    } else {
-        // If no prev, this was the tail
-        map->tail = item->next;
+#ifdef STATIC_MAP_UNORDERED
+    if (staticMapItemState(iter->item) != STATIC_MAP_SLOT_IN_USE) {
+        return STATIC_MAP_UNUSED_ERASE;
     }
 
-    if (item->next) {
-        item->next->prev = item->prev;
-    } else {
-        // If no next, this was the head
-        map->head = item->prev;
+    if (FROZEN(iter->map)) {
+        return STATIC_MAP_FROZEN;
     }
 
-    item->state = STATIC_MAP_SLOT_DELETED;
-    item->next  = NULL;
-    item->prev  = NULL;
+    // Closing the gap now could pull an item that was already visited into a later slot
+    writeBegin(iter->map);
+    tombstoneAt(iter->map, iter->index);
+    writeEnd(iter->map);
+    iter->erased = true;
+#else
+    // A strided remove or a grow step may move the next item, look it up again afterwards
+    bool find_next = (iter->map->items == NULL || GROWING(iter->map)) && iter->next != NULL;
+    uint32_t next_key  = find_next ? iter->next->key : 0;
+    uint32_t next_hash = find_next ? slotHash(iter->map, iter->next) : 0;
+
+    int32_t result = staticMapRemove(iter->map, iter->item);
+    if (result != STATIC_MAP_SUCCESS) {
+        return result;
+    }
 
-    // TODO, we could add some kind of cleanup routine here to get rid of tombstones
+    if (find_next) {
+        iter->next = lookupKey(iter->map, next_key, next_hash);
+    }
+#endif
 
+    iter->item = NULL;
     return STATIC_MAP_SUCCESS;
 }
 
-int32_t staticMapRemoveByKey(staticMap_t *map, uint32_t key) {
+int32_t staticMapForEach(staticMap_t *map, int32_t (*callback)(staticMap_t *map, staticMapItem_t *item)) {
+    if (map == NULL || callback == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    bool stop = false;
+    return staticMapForEachWalk(map, callback, &stop);
+}
+
+int32_t staticMapForEachWalk(staticMap_t *map, int32_t (*callback)(staticMap_t *map, staticMapItem_t *item), bool *stop) {
+    int32_t result = STATIC_MAP_SUCCESS;
+    staticMapIter_t iter;
+
+    *stop = false;
+    STATIC_MAP_FOREACH(map, iter, current) {
+        int32_t cb_res = callback(map, current);
+        if (cb_res == STATIC_MAP_CB_NEXT) {
+            continue;
+        }
+
+        if (cb_res == STATIC_MAP_CB_ERASE) {
+            // Erase this item from the map
+            if ((result = staticMapIterErase(&iter)) != STATIC_MAP_SUCCESS) {
+                *stop = true;
+                break;
+            }
+            continue;
+        }
+
+        if (cb_res != STATIC_MAP_CB_STOP) {
+            result = cb_res;
+        }
+        *stop = true;
+        break;
+    }
+
+#ifdef STATIC_MAP_UNORDERED
+    // The loop was left early, reclaim the erased slots here instead
+    if (iter.erased) {
+        staticMapCompact(map);
+    }
+#endif
+
+    return result;
+}
+
+int32_t staticMapGetNumItems(staticMap_t *map) {
     if (map == NULL) {
         return STATIC_MAP_NULL_ERROR;
     }
 
-    uint32_t index = hash_func(map, key);
+    if (map->shared != NULL) {
+        // Kept up to date by the writer process
+        return (int32_t)sharedCount(map);
+    }
 
-    for (uint32_t attempt = 0; attempt < map->length; attempt++) {
-        staticMapItem_t *slot = map->items[index];
+    return (int32_t)map->count;
+}
 
-        if (slot->state == STATIC_MAP_SLOT_EMPTY) {
-            // We reached an empty slot; the key isn't in the table
-            return STATIC_MAP_UNUSED_ERASE;
+int32_t staticMapGetStats(staticMap_t *map, staticMapStats_t *stats) {
+    if (map == NULL || stats == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+
+    uint64_t total_distance = 0;
+    for (uint32_t index = 0; index < map->length; index++) {
+        staticMapItem_t *slot = staticMapSlotItem(map, index);
+
+        if (staticMapItemState(slot) == STATIC_MAP_SLOT_EMPTY) {
+            stats->empty++;
+        }
+        else if (staticMapItemState(slot) == STATIC_MAP_SLOT_DELETED) {
+            stats->tombstones++;
         }
+        else {
+            uint32_t distance = homeDistance(map, slot, index);
 
-        if (slot->state == STATIC_MAP_SLOT_IN_USE && slot->key == key) {
-            // Found the key; mark this slot as deleted
-            slot->state = STATIC_MAP_SLOT_DELETED;
+            stats->in_use++;
+            total_distance += distance;
 
-            // Unlink from the active list
-            if (slot->prev) {
-                slot->prev->next = slot->next;
-            } else {
-                // If no prev, this was the tail
-                map->tail = slot->next;
+            if (distance > stats->max_probe_distance) {
+                stats->max_probe_distance = distance;
             }
 
-            if (slot->next) {
-                slot->next->prev = slot->prev;
-            } else {
-                // If no next, this was the head
-                map->head = slot->prev;
+            // The last bucket collects everything that is further away
+            if (distance >= STATIC_MAP_PROBE_HISTOGRAM_SIZE) {
+                distance = STATIC_MAP_PROBE_HISTOGRAM_SIZE - 1;
             }
+            stats->probe_histogram[distance]++;
+        }
+    }
 
-            slot->state = STATIC_MAP_SLOT_DELETED;
-            slot->next  = NULL;
-            slot->prev  = NULL;
+    stats->load_factor = (float)stats->in_use / (float)map->length;
+    if (stats->in_use > 0) {
+        stats->avg_probe_distance = (float)total_distance / (float)stats->in_use;
+    }
 
-            return STATIC_MAP_SUCCESS;
+#ifdef STATIC_MAP_STATS
+    stats->counters = map->counters;
+#endif
+
+    return STATIC_MAP_SUCCESS;
+}
+
+int32_t staticMapResetStats(staticMap_t *map) {
+    if (map == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+#ifdef STATIC_MAP_STATS
+    memset(&map->counters, 0, sizeof(map->counters));
+#endif
+
+    return STATIC_MAP_SUCCESS;
+}
+
+// Snapshot image layout: header, length items of item_size bytes in slot order, then the ctrl bytes
+#define IMAGE_MAGIC   0x50414d53 // "SMAP"
+#define IMAGE_VERSION 1
+#define IMAGE_NONE    UINT32_MAX // No list neighbour
+#define IMAGE_CTRL    0x1        // Image flag, ctrl bytes follow the items
+
+typedef struct staticMapImage {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t layout;      // Node size and build options, must match to load
+    uint32_t flags;
+    uint64_t length;
+    uint64_t item_size;
+    uint64_t node_offset;
+    uint64_t count;
+    uint32_t head;        // Slot index of the newest item
+    uint32_t tail;        // Slot index of the oldest item
+    uint32_t probe;
+    uint32_t seed;
+    uint32_t seq;         // Sequence number of a process shared map
+    uint32_t reserved;
+} imageHeader_t;
+
+// Identifies the node layout, an image only loads into a build that agrees on it
+static uint32_t imageLayout(void) {
+    uint32_t layout = (uint32_t)sizeof(staticMapItem_t);
+#ifdef STATIC_MAP_COMPACT_NODE
+    layout |= 1u << 16;
+#endif
+#ifdef STATIC_MAP_UNORDERED
+    layout |= 1u << 17;
+#endif
+#ifdef STATIC_MAP_TTL
+    layout |= 1u << 18;
+#endif
+#ifdef STATIC_MAP_INDEX_16
+    layout |= 1u << 19;
+#endif
+#ifdef STATIC_MAP_STORED_HASH
+    layout |= 1u << 20;
+#endif
+    return layout;
+}
+
+static size_t imageSize(size_t length, size_t item_size, bool ctrl) {
+    return sizeof(imageHeader_t) + length * item_size + (ctrl ? STATIC_MAP_CTRL_BYTES(length) : 0);
+}
+
+#ifndef STATIC_MAP_UNORDERED
+// Slot index of a list neighbour, IMAGE_NONE for the end of the list
+static uint32_t imageLink(staticMap_t *map, staticMapItem_t *item) {
+    return item == NULL ? IMAGE_NONE : findItemIndex(map, item);
+}
+
+// Node of the item in slot index of a strided map
+static inline staticMapItem_t *imageNode(uint8_t *items, size_t item_size, size_t node_offset, uint32_t index) {
+    return (staticMapItem_t *)(items + (size_t)index * item_size + node_offset);
+}
+#endif
+
+size_t staticMapSnapshotSize(staticMap_t *map) {
+    if (map == NULL) {
+        return 0;
+    }
+
+    return imageSize(map->length, map->item_size, map->ctrl != NULL);
+}
+
+int32_t staticMapSnapshot(staticMap_t *map, void *buffer, size_t size) {
+    if (map == NULL || buffer == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    if (GROWING(map) || !map->node_offset_set) {
+        // Entries are spread over two tables, or the start of the user structs is unknown
+        return STATIC_MAP_INVALID_CONFIG;
+    }
+
+    if (size < staticMapSnapshotSize(map)) {
+        return STATIC_MAP_FULL;
+    }
+
+    imageHeader_t *header = (imageHeader_t *)buffer;
+    uint8_t *items = (uint8_t *)buffer + sizeof(imageHeader_t);
+
+    memset(header, 0, sizeof(*header));
+    header->magic       = IMAGE_MAGIC;
+    header->version     = IMAGE_VERSION;
+    header->layout      = imageLayout();
+    header->flags       = map->ctrl != NULL ? IMAGE_CTRL : 0;
+    header->length      = map->length;
+    header->item_size   = map->item_size;
+    header->node_offset = map->node_offset;
+    header->count       = map->count;
+    header->probe       = (uint32_t)map->probe;
+    header->seed        = map->seed;
+#ifndef STATIC_MAP_UNORDERED
+    header->head        = imageLink(map, map->head);
+    header->tail        = imageLink(map, map->tail);
+#else
+    header->head        = IMAGE_NONE;
+    header->tail        = IMAGE_NONE;
+#endif
+
+    // Copy every slot, the image is laid out like a strided map. A map loaded from this
+    // buffer already has its structs in place, only the header and the links are rewritten
+    for (uint32_t index = 0; index < map->length; index++) {
+        uint8_t *slot = (uint8_t *)staticMapSlotItem(map, index) - map->node_offset;
+        if (slot != items + (size_t)index * map->item_size) {
+            memcpy(items + (size_t)index * map->item_size, slot, map->item_size);
         }
-        index = LINEAR_PROBE(index, map->length);
     }
 
-    return STATIC_MAP_INVALID_KEY;
+#ifndef STATIC_MAP_UNORDERED
+    // Rewrite the list links of the copies as slot indices
+    for (uint32_t index = 0; index < map->length; index++) {
+        staticMapItem_t *slot = staticMapSlotItem(map, index);
+        staticMapItem_t *copy = imageNode(items, map->item_size, map->node_offset, index);
+        bool in_use = staticMapItemState(slot) == STATIC_MAP_SLOT_IN_USE;
+
+        uint32_t next = in_use ? imageLink(map, staticMapItemNext(map, slot)) : IMAGE_NONE;
+        uint32_t prev = in_use ? imageLink(map, nodePrev(map, slot)) : IMAGE_NONE;
+#ifdef STATIC_MAP_COMPACT_NODE
+        // Slot and storage index are the same in the image, the links load as they are
+        copy->next       = next == IMAGE_NONE ? STATIC_MAP_LINK_NONE : (staticMapLink_t)next;
+        copy->prev_state = (staticMapLink_t)((prev == IMAGE_NONE ? STATIC_MAP_LINK_NONE : prev) |
+                                             ((staticMapLink_t)staticMapItemState(slot) << STATIC_MAP_LINK_BITS));
+#else
+        // Stored as index + 1 so the end of the list stays NULL
+        copy->next = (staticMapItem_t *)(uintptr_t)(next == IMAGE_NONE ? 0 : (uintptr_t)next + 1);
+        copy->prev = (staticMapItem_t *)(uintptr_t)(prev == IMAGE_NONE ? 0 : (uintptr_t)prev + 1);
+#endif
+    }
+#endif
+
+    if (map->ctrl != NULL && map->ctrl != items + map->length * map->item_size) {
+        memcpy(items + map->length * map->item_size, map->ctrl, STATIC_MAP_CTRL_BYTES(map->length));
+    }
+
+    return STATIC_MAP_SUCCESS;
 }
 
-int32_t staticMapForEach(staticMap_t *map, int32_t (*callback)(staticMap_t *map, staticMapItem_t *item)) {
-    if (map == NULL || callback == NULL) {
+// Point a map at an image, the list links are left as they are stored
+static int32_t attachImage(staticMap_t *map, void *image, size_t size, const staticMapConfig_t *config) {
+    if (map == NULL || image == NULL) {
         return STATIC_MAP_NULL_ERROR;
     }
 
-    staticMapItem_t *current = map->tail;
-    while (current != NULL) {
-        int32_t cb_res = callback(map, current);
-        switch(cb_res) {
-            case STATIC_MAP_CB_NEXT:
-                current = current->next;
-                break;
-            case STATIC_MAP_CB_STOP:
-                return STATIC_MAP_SUCCESS;
-            case STATIC_MAP_CB_ERASE: {
-                staticMapItem_t *tmp = current;
-                current = current->next;
-                // Erase this item from the map
-                if ((cb_res = staticMapRemove(map, tmp)) != STATIC_MAP_SUCCESS) {
-                    return cb_res;
-                }
-            } break;
-            default:
-               return cb_res;
+    imageHeader_t *header = (imageHeader_t *)image;
+    if (size < sizeof(imageHeader_t) || header->magic != IMAGE_MAGIC || header->version != IMAGE_VERSION ||
+        header->layout != imageLayout()) {
+        return STATIC_MAP_INVALID_IMAGE;
+    }
+
+    bool ctrl = (header->flags & IMAGE_CTRL) != 0;
+    if (header->length == 0 || header->length > UINT32_MAX || header->item_size < sizeof(staticMapItem_t) ||
+        header->node_offset + sizeof(staticMapItem_t) > header->item_size || header->count > header->length ||
+        header->length > (SIZE_MAX - sizeof(imageHeader_t)) / header->item_size / 2 ||
+        size < imageSize((size_t)header->length, (size_t)header->item_size, ctrl) ||
+        (header->probe != STATIC_MAP_PROBE_LINEAR && header->probe != STATIC_MAP_PROBE_ROBIN_HOOD &&
+         header->probe != STATIC_MAP_PROBE_CUCKOO)) {
+        return STATIC_MAP_INVALID_IMAGE;
+    }
+
+    staticMapConfig_t defaults = {0};
+    if (config == NULL) {
+        config = &defaults;
+    }
+
+    if (config->capacity > header->length) {
+        return STATIC_MAP_INVALID_CONFIG;
+    }
+
+    if (header->probe == STATIC_MAP_PROBE_CUCKOO && !cuckooConfigValid((size_t)header->length, ctrl, config->concurrent)) {
+        return STATIC_MAP_INVALID_CONFIG;
+    }
+
+    uint8_t *items = (uint8_t *)image + sizeof(imageHeader_t);
+    size_t length  = (size_t)header->length;
+
+    map->items            = NULL;   // Strided over the image
+    map->length           = length;
+    map->base             = items + header->node_offset;
+    map->item_size        = (size_t)header->item_size;
+    map->node_offset      = (size_t)header->node_offset;
+    map->node_offset_set  = true;
+    map->probe            = (staticMapProbe_t)header->probe;
+    map->hash             = config->hash;
+    map->seed             = header->seed;
+    map->mask             = ((length & (length - 1)) == 0) ? (uint32_t)(length - 1) : 0;
+    map->ctrl             = ctrl ? items + length * map->item_size : NULL;
+    map->count            = (size_t)header->count;
+    map->capacity         = config->capacity ? config->capacity : length;
+    map->evict            = config->evict;
+    map->concurrent       = config->concurrent;
+    map->seq              = 0;
+    map->write_depth      = 0;
+    map->shared           = NULL;
+    map->stashed          = 0;
+    memset(&map->old, 0, sizeof(map->old));
+    memset(&map->frozen, 0, sizeof(map->frozen));
+#ifdef STATIC_MAP_STATS
+    memset(&map->counters, 0, sizeof(map->counters));
+#endif
+
+    if (map->probe == STATIC_MAP_PROBE_CUCKOO) {
+        for (uint32_t index = cuckooStash(map); index < length; index++) {
+            map->stashed += staticMapItemState(staticMapSlotItem(map, index)) != STATIC_MAP_SLOT_EMPTY ? 1 : 0;
         }
     }
 
+#ifndef STATIC_MAP_UNORDERED
+    if ((header->head == IMAGE_NONE) != (header->tail == IMAGE_NONE) ||
+        (header->head != IMAGE_NONE && (header->head >= length || header->tail >= length))) {
+        return STATIC_MAP_INVALID_IMAGE;
+    }
+
+    map->head     = header->head == IMAGE_NONE ? NULL : staticMapSlotItem(map, header->head);
+    map->tail     = header->tail == IMAGE_NONE ? NULL : staticMapSlotItem(map, header->tail);
+    map->bulk_key = 0;
+#endif
+
     return STATIC_MAP_SUCCESS;
 }
 
-int32_t staticMapGetNumItems(staticMap_t *map) {
+int32_t staticMapLoad(staticMap_t *map, void *image, size_t size, const staticMapConfig_t *config) {
+    int32_t result = attachImage(map, image, size, config);
+    if (result != STATIC_MAP_SUCCESS) {
+        return result;
+    }
+
+#if !defined(STATIC_MAP_UNORDERED) && !defined(STATIC_MAP_COMPACT_NODE)
+    // Turn the stored index + 1 links into pointers, following the list only touches the items in use
+    size_t linked = 0;
+    for (staticMapItem_t *item = map->tail; item != NULL; ) {
+        uintptr_t next = (uintptr_t)item->next;
+        uintptr_t prev = (uintptr_t)item->prev;
+
+        if (next > map->length || prev > map->length || ++linked > map->count) {
+            return STATIC_MAP_INVALID_IMAGE;
+        }
+
+        item->next = next ? staticMapSlotItem(map, (uint32_t)(next - 1)) : NULL;
+        item->prev = prev ? staticMapSlotItem(map, (uint32_t)(prev - 1)) : NULL;
+        item = item->next;
+    }
+#endif
+
+    return STATIC_MAP_SUCCESS;
+}
+
+// Process shared maps keep the image header at the start of the region, the items and ctrl bytes follow
+#if defined(STATIC_MAP_COMPACT_NODE) || defined(STATIC_MAP_UNORDERED)
+#define SHARED_SUPPORTED 1
+#else
+#define SHARED_SUPPORTED 0 // Pointer links only make sense in one address space
+#endif
+
+static uint32_t *sharedSeq(const staticMap_t *map) {
+    return &map->shared->seq;
+}
+
+static size_t sharedCount(const staticMap_t *map) {
+    return (size_t)__atomic_load_n(&map->shared->count, __ATOMIC_RELAXED);
+}
+
+// Publish the count and the list ends of the writer to the region
+static void sharedSync(staticMap_t *map) {
+    imageHeader_t *header = map->shared;
+
+    __atomic_store_n(&header->count, (uint64_t)map->count, __ATOMIC_RELAXED);
+#ifndef STATIC_MAP_UNORDERED
+    __atomic_store_n(&header->head, imageLink(map, map->head), __ATOMIC_RELAXED);
+    __atomic_store_n(&header->tail, imageLink(map, map->tail), __ATOMIC_RELAXED);
+#endif
+}
+
+size_t staticMapSharedSize(size_t length, size_t item_size, bool ctrl) {
+    return imageSize(length, item_size, ctrl);
+}
+
+int32_t staticMapSharedCreate(staticMap_t *map, void *region, size_t size, size_t length, size_t item_size,
+                              size_t node_offset, bool ctrl, const staticMapConfig_t *config) {
+    if (map == NULL || region == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    if (!SHARED_SUPPORTED || ((uintptr_t)region & 7) != 0) {
+        return STATIC_MAP_INVALID_CONFIG;
+    }
+
+    if (length == 0 || item_size == 0 || length > (SIZE_MAX - sizeof(imageHeader_t)) / item_size / 2) {
+        return STATIC_MAP_INVALID_CONFIG;
+    }
+
+    if (size < imageSize(length, item_size, ctrl)) {
+        return STATIC_MAP_FULL;
+    }
+
+    imageHeader_t *header = (imageHeader_t *)region;
+    uint8_t *items = (uint8_t *)region + sizeof(imageHeader_t);
+
+    staticMapConfig_t shared_config = {0};
+    if (config != NULL) {
+        shared_config = *config;
+    }
+    shared_config.ctrl        = ctrl ? items + length * item_size : NULL;
+    shared_config.node_offset = node_offset;
+    shared_config.concurrent  = true;   // Readers in other processes always use the seqlock
+
+    int32_t result = initMap(map, NULL, length, item_size, (staticMapItem_t *)(items + node_offset), &shared_config);
+    if (result != STATIC_MAP_SUCCESS) {
+        return result;
+    }
+
+    memset(header, 0, sizeof(*header));
+    header->version     = IMAGE_VERSION;
+    header->layout      = imageLayout();
+    header->flags       = ctrl ? IMAGE_CTRL : 0;
+    header->length      = length;
+    header->item_size   = item_size;
+    header->node_offset = node_offset;
+    header->head        = IMAGE_NONE;
+    header->tail        = IMAGE_NONE;
+    header->probe       = (uint32_t)map->probe;
+    header->seed        = map->seed;
+
+    // Attaching processes check the magic, write it once everything else is in place
+    __atomic_store_n(&header->magic, IMAGE_MAGIC, __ATOMIC_RELEASE);
+
+    map->shared = header;
+    return STATIC_MAP_SUCCESS;
+}
+
+int32_t staticMapSharedAttach(staticMap_t *map, void *region, size_t size, const staticMapConfig_t *config) {
+    if (map == NULL || region == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    if (!SHARED_SUPPORTED) {
+        return STATIC_MAP_INVALID_CONFIG;
+    }
+
+    if (size >= sizeof(imageHeader_t) &&
+        __atomic_load_n(&((imageHeader_t *)region)->magic, __ATOMIC_ACQUIRE) != IMAGE_MAGIC) {
+        return STATIC_MAP_INVALID_IMAGE;
+    }
+
+    int32_t result = attachImage(map, region, size, config);
+    if (result != STATIC_MAP_SUCCESS) {
+        return result;
+    }
+
+    map->concurrent = true;
+    map->shared     = (imageHeader_t *)region;
+    return STATIC_MAP_SUCCESS;
+}
+
+int32_t staticMapSharedDetach(staticMap_t *map) {
     if (map == NULL) {
         return STATIC_MAP_NULL_ERROR;
     }
 
-    int32_t count = 0;
-    staticMapItem_t *current = map->tail;
-    while (current != NULL) {
-        count++;
-        current = current->next;
+    if (map->shared == NULL || map->write_depth != 0) {
+        return STATIC_MAP_INVALID_CONFIG;
     }
 
-    return count;
-}
\ No newline at end of file
+    // Leave the instance empty, nothing points into the region afterwards
+    memset(map, 0, sizeof(*map));
+    return STATIC_MAP_SUCCESS;
+}
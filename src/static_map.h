@@ -40,17 +40,24 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#if defined(STATIC_MAP_UNORDERED) && defined(STATIC_MAP_TTL)
+#error "STATIC_MAP_TTL expires items in list order and can not be used with STATIC_MAP_UNORDERED"
+#endif
+
 #ifndef CONTAINER_OF
 #define CONTAINER_OF(ptr, type, member)	(type *)((char *)(ptr) - offsetof(type,member))
 #endif
 
 typedef enum {
     STATIC_MAP_SUCCESS,
-    STATIC_MAP_NULL_ERROR   = -201,
-    STATIC_MAP_EMPTY        = -202,
-    STATIC_MAP_FULL         = -203,
-    STATIC_MAP_UNUSED_ERASE = -204,
-    STATIC_MAP_INVALID_KEY  = -205,
+    STATIC_MAP_NULL_ERROR     = -201,
+    STATIC_MAP_EMPTY          = -202,
+    STATIC_MAP_FULL           = -203,
+    STATIC_MAP_UNUSED_ERASE   = -204,
+    STATIC_MAP_INVALID_KEY    = -205,
+    STATIC_MAP_INVALID_CONFIG = -206,
+    STATIC_MAP_INVALID_IMAGE  = -207,
+    STATIC_MAP_FROZEN         = -208, // The map is read only until staticMapUnfreeze
 } staticMapErr_t;
 
 typedef enum {
@@ -65,30 +72,290 @@ typedef enum {
     STATIC_MAP_CB_ERASE,    // Erase this node and keep iterating
 } staticMapCbDo_t;
 
+// Number of control bytes checked at once by a group probe
+#define STATIC_MAP_GROUP_WIDTH 16
+
+// Size of the optional control byte array for a map of the given length
+#define STATIC_MAP_CTRL_BYTES(length) ((length) + STATIC_MAP_GROUP_WIDTH - 1)
+
+// Number of buckets in the probe distance histogram reported by staticMapGetStats
+#ifndef STATIC_MAP_PROBE_HISTOGRAM_SIZE
+#define STATIC_MAP_PROBE_HISTOGRAM_SIZE 16
+#endif
+
+// Slots of the old table migrated by every insert and remove while a grow is running
+#ifndef STATIC_MAP_GROW_STEP
+#define STATIC_MAP_GROW_STEP 4
+#endif
+
+typedef enum {
+    STATIC_MAP_PROBE_LINEAR = 0, // Plain linear probing, take the first free slot
+    STATIC_MAP_PROBE_ROBIN_HOOD, // Linear probing where inserts displace entries closer to their home bucket
+    STATIC_MAP_PROBE_CUCKOO,     // Two buckets of four slots per key and a small stash, a lookup reads at most
+                                 // two buckets and the stash. Needs 12 or more slots, no ctrl bytes and no
+                                 // concurrent readers
+} staticMapProbe_t;
+
+/**
+ * Hash function used to place keys in the map
+ * Input: The key
+ * Input: The seed given in the map configuration
+ * Returns: A 32-bit hash, all bits should be well mixed
+ */
+typedef uint32_t (*staticMapHash_t)(uint32_t key, uint32_t seed);
+
 typedef struct staticMapItem staticMapItem_t;
+typedef struct staticMap staticMap_t;
+struct staticMapImage; // Header of a snapshot image or shared region
 
 /**
- * This item should be embedded into what ever struct that should be put in the map
+ * Called by staticMapInsertOrEvict with the entry that is about to be evicted.
+ * The item is still in the map and its key is valid, the callback must not modify the map
  */
+typedef void (*staticMapEvict_t)(staticMap_t *map, staticMapItem_t *item);
+
+#ifdef STATIC_MAP_COMPACT_NODE
+/**
+ * Compact nodes link items by their index in the item storage instead of by pointer.
+ * The top two bits of the prev link hold the slot state, the rest is the index.
+ * 32-bit links give a 12 byte node and up to 2^30 - 1 items, with STATIC_MAP_INDEX_16
+ * the node is 8 bytes and a map holds up to 2^14 - 1 items
+ */
+#ifdef STATIC_MAP_INDEX_16
+typedef uint16_t staticMapLink_t;
+#else
+typedef uint32_t staticMapLink_t;
+#endif
+
+#define STATIC_MAP_LINK_BITS  (sizeof(staticMapLink_t) * 8 - 2)
+#define STATIC_MAP_LINK_MASK  ((staticMapLink_t)((1u << STATIC_MAP_LINK_BITS) - 1))
+#define STATIC_MAP_LINK_NONE  STATIC_MAP_LINK_MASK // End of the list
+#define STATIC_MAP_MAX_ITEMS  STATIC_MAP_LINK_MASK // Largest map length with compact nodes
+#endif
+
+/**
+ * This item should be embedded into what ever struct that should be put in the map.
+ * Read the state with staticMapItemState, the layout depends on the build options
+ */
+#ifndef STATIC_MAP_COMPACT_NODE
 struct staticMapItem {
     staticMapslotState_t state;
     uint32_t             key; // This is the map key
-    staticMapItem_t     *next;
+#ifdef STATIC_MAP_STORED_HASH
+    uint32_t             hash; // Hash of the key, moves and probes never hash again
+#endif
+#ifndef STATIC_MAP_UNORDERED
+    staticMapItem_t     *next; // Insertion order list, dropped in unordered maps
     staticMapItem_t     *prev;
+#endif
+#ifdef STATIC_MAP_TTL
+    uint32_t             deadline; // Expiry time, set with staticMapSetDeadline
+#endif
 };
+#else
+struct staticMapItem {
+    uint32_t             key; // This is the map key
+#ifdef STATIC_MAP_STORED_HASH
+    uint32_t             hash; // Hash of the key, moves and probes never hash again
+#endif
+#ifndef STATIC_MAP_UNORDERED
+    staticMapLink_t      next;       // Storage index of the next newer item
+    staticMapLink_t      prev_state; // Storage index of the next older item and the slot state
+#else
+    uint8_t              state;
+#endif
+#ifdef STATIC_MAP_TTL
+    uint32_t             deadline; // Expiry time, set with staticMapSetDeadline
+#endif
+};
+#endif
+
+#ifdef STATIC_MAP_STATS
+/**
+ * Per operation counters, only kept when built with STATIC_MAP_STATS
+ */
+typedef struct {
+    uint64_t lookups;         // Calls to staticMapFind
+    uint64_t lookup_misses;   // Lookups that did not find the key
+    uint64_t probes;          // Slots (or control groups) inspected by lookups and removes by key
+    uint32_t max_probe;       // Longest single probe seen
+    uint64_t inserts;         // Successful inserts
+    uint64_t insert_failures; // Inserts rejected because the key existed or the map was full
+    uint64_t removes;         // Removed items
+    uint64_t evictions;       // Items evicted by staticMapInsertOrEvict or expired
+} staticMapCounters_t;
+#endif
+
+/**
+ * Table that a running grow is draining, entries move to the new table a few slots at a time
+ */
+typedef struct {
+    staticMapItem_t **items;  // NULL when the old table is strided
+    uint8_t          *base;
+    uint8_t          *ctrl;
+    size_t            length; // 0 when no grow is running
+    uint32_t          mask;
+    size_t            count;  // Entries not migrated yet
+    uint32_t          cursor; // Next slot to migrate, every entry before it has moved
+} staticMapGrowTable_t;
+
+/**
+ * Key and slot of one position of the perfect hash of a frozen map
+ */
+typedef struct {
+    uint32_t key;
+    uint32_t slot;
+} staticMapFrozenEntry_t;
+
+/**
+ * Perfect hash built by staticMapFreeze, it lives in the caller's buffer
+ */
+typedef struct {
+    staticMapFrozenEntry_t *entries; // One per key, NULL while the map is not frozen
+    uint32_t               *disp;    // Displacement of every bucket of keys
+    uint32_t                size;    // Number of keys when the map was frozen
+    uint32_t                buckets;
+} staticMapFrozen_t;
 
 /**
  * This is the actuall map object
  */
-typedef struct staticMap {
-    staticMapItem_t **items;  // Pointer to an array of map item pointers
+struct staticMap {
+    staticMapItem_t **items;  // Pointer to an array of map item pointers, NULL in a strided map
     size_t            length; // The size of the array
+    uint8_t          *base;      // First item in the item storage
+    size_t            item_size; // Distance between items in the storage
+    size_t            node_offset; // Offset of the node in the user struct, strided maps copy whole structs
+    bool              node_offset_set; // The offset was given at init, whole structs can be copied
+#ifndef STATIC_MAP_UNORDERED
     staticMapItem_t  *tail;
     staticMapItem_t  *head;
-} staticMap_t;
+    size_t            bulk_key; // Index + 1 of the key a bulk insert is placing, its items are linked at the end
+#endif
+    staticMapProbe_t  probe;  // Probing scheme used by this map
+    uint32_t          stashed; // Cuckoo stash slots in use or deleted, the stash is only read when this is set
+    staticMapHash_t   hash;   // Hash function, NULL for the default mixer
+    uint32_t          seed;   // Seed passed to the hash function
+    uint32_t          mask;   // length - 1 when length is a power of two, otherwise 0
+    uint8_t          *ctrl;   // Optional control bytes, one per slot
+    size_t            count;  // Number of items in use
+    size_t            capacity; // staticMapInsertOrEvict evicts the oldest item at this many items
+    staticMapEvict_t  evict;  // Optional eviction callback
+    bool              concurrent;  // Writers publish every change through seq
+    uint32_t          seq;         // Odd while the writer is modifying the map
+    uint32_t          write_depth; // Nesting of write sections, only touched by the writer
+    struct staticMapImage *shared; // Region of a process shared map, holds the sequence number, NULL otherwise
+    staticMapGrowTable_t old;      // Source of a running grow
+    staticMapFrozen_t    frozen;   // Perfect hash of a frozen map
+#ifdef STATIC_MAP_STATS
+    staticMapCounters_t counters;
+#endif
+};
+
+/**
+ * Item stored in a slot
+ * Input: Pointer to a static map instance
+ * Input: Slot index, below map->length
+ * Returns: The item
+ */
+static inline staticMapItem_t *staticMapSlotItem(const staticMap_t *map, uint32_t index) {
+    if (map->items != NULL) {
+        return map->items[index];
+    }
+    return (staticMapItem_t *)(map->base + (size_t)index * map->item_size);
+}
+
+/**
+ * Slot state of an item
+ * Input: Item
+ * Returns: staticMapslotState_t
+ */
+static inline staticMapslotState_t staticMapItemState(const staticMapItem_t *item) {
+#if defined(STATIC_MAP_COMPACT_NODE) && !defined(STATIC_MAP_UNORDERED)
+    return (staticMapslotState_t)(item->prev_state >> STATIC_MAP_LINK_BITS);
+#else
+    return (staticMapslotState_t)item->state;
+#endif
+}
+
+#ifndef STATIC_MAP_UNORDERED
+/**
+ * The next newer item in the map list
+ * Input: Pointer to a static map instance
+ * Input: Item
+ * Returns: The item, NULL if this is the newest
+ */
+static inline staticMapItem_t *staticMapItemNext(const staticMap_t *map, const staticMapItem_t *item) {
+#ifdef STATIC_MAP_COMPACT_NODE
+    if (item->next == STATIC_MAP_LINK_NONE) {
+        return NULL;
+    }
+    return (staticMapItem_t *)(map->base + (size_t)item->next * map->item_size);
+#else
+    (void)map;
+    return item->next;
+#endif
+}
+#endif
+
+/**
+ * Snapshot of the map layout, the probe distance is how far an entry sits from its home bucket
+ */
+typedef struct {
+    size_t   in_use;             // Slots in use
+    size_t   tombstones;         // Slots marked deleted
+    size_t   empty;              // Never used or reclaimed slots
+    float    load_factor;        // in_use / length
+    uint32_t max_probe_distance; // Furthest any entry is from its home bucket
+    float    avg_probe_distance; // Average distance over all entries
+    uint32_t probe_histogram[STATIC_MAP_PROBE_HISTOGRAM_SIZE]; // Entries per distance, the last bucket holds the rest
+#ifdef STATIC_MAP_STATS
+    staticMapCounters_t counters;
+#endif
+} staticMapStats_t;
+
+/**
+ * Optional map configuration, a zero initialized config gives the default map
+ */
+typedef struct {
+    staticMapProbe_t probe; // Probing scheme
+    staticMapHash_t  hash;  // Hash function, NULL selects staticMapHashMix32
+    uint32_t         seed;  // Seed for the hash function
+    uint8_t         *ctrl;  // Optional array of STATIC_MAP_CTRL_BYTES(length) control bytes
+    size_t           capacity; // Item limit for staticMapInsertOrEvict, 0 means length
+    staticMapEvict_t evict; // Called for every item staticMapInsertOrEvict evicts
+    bool             concurrent; // Allow lock free readers next to a single writer, see staticMapFindConcurrent
+    size_t           node_offset; // Offset of the node in the user struct, lets snapshots include data before the node
+} staticMapConfig_t;
 
 /**
- * Initialize the static map, and populate map array
+ * Murmur3 finalizer, the default hash. Spreads sequential and strided keys evenly
+ * Input: The key
+ * Input: Seed
+ * Returns: The hash
+ */
+uint32_t staticMapHashMix32(uint32_t key, uint32_t seed);
+
+/**
+ * Fibonacci hashing, a single multiply. Cheaper than the default but mixes less
+ * Input: The key
+ * Input: Seed
+ * Returns: The hash
+ */
+uint32_t staticMapHashFibonacci(uint32_t key, uint32_t seed);
+
+/**
+ * No hashing, the key is used as is. Gives the old key % length placement
+ * Input: The key
+ * Input: Seed
+ * Returns: The hash
+ */
+uint32_t staticMapHashIdentity(uint32_t key, uint32_t seed);
+
+/**
+ * Initialize the static map, and populate map array.
+ * The map does not know the offset of the node in the user struct, so it can not be grown or
+ * snapshotted unless the items are bare nodes, use STATIC_MAP_INIT for that
  * Input: Pointer to a static map instance
  * Input: Pointer to the static map items array
  * Input: Size of the map array
@@ -98,6 +365,40 @@ typedef struct staticMap {
  */
 int32_t staticMapInit(staticMap_t *map, staticMapItem_t **itemsArray, size_t length, size_t item_size, staticMapItem_t *first_item);
 
+/**
+ * Initialize the static map with a configuration
+ * Robin Hood probing keeps every cluster ordered by home bucket, which bounds the probe
+ * length at high load and lets lookups stop early on a miss.
+ * A power of two length lets the map use a mask instead of a division when probing.
+ * With a control byte array the map keeps a 7-bit fingerprint of every key next to the
+ * slot state and probes STATIC_MAP_GROUP_WIDTH slots at a time, only items with a
+ * matching fingerprint are dereferenced
+ * Input: Pointer to a static map instance
+ * Input: Pointer to the static map items array
+ * Input: Size of the map array
+ * Input: Size of each item
+ * Input: Pointer to hte first item
+ * Input: Pointer to a map configuration, NULL gives the default map
+ * Returns: staticMapErr_t
+ */
+int32_t staticMapInitWithConfig(staticMap_t *map, staticMapItem_t **itemsArray, size_t length, size_t item_size, staticMapItem_t *first_item, const staticMapConfig_t *config);
+
+/**
+ * Initialize a map without the items pointer array, slot i is the item at first_item + i * item_size.
+ * A probe reads the item directly instead of going through a pointer, and the pointer array is not needed.
+ * Entries are moved by copying the whole item instead of swapping pointers, so an item pointer is only
+ * valid until the next insert or remove. Keep the items small, item_size bytes are copied per move
+ * Input: Pointer to a static map instance
+ * Input: Number of items
+ * Input: Size of each item
+ * Input: Pointer to the first item
+ * Input: Offset of the staticMapItem_t in the user struct, offsetof(type, member)
+ * Input: Pointer to a map configuration, NULL gives the default map
+ * Returns: staticMapErr_t
+ */
+int32_t staticMapInitStrided(staticMap_t *map, size_t length, size_t item_size, staticMapItem_t *first_item,
+                             size_t node_offset, const staticMapConfig_t *config);
+
 /**
  * Get the a new item at the key position, and set it as in use
  * Input: Pointer to a static map instance
@@ -106,6 +407,17 @@ int32_t staticMapInit(staticMap_t *map, staticMapItem_t **itemsArray, size_t len
  */
  staticMapItem_t *staticMapInsertAndGet(staticMap_t *map, uint32_t key);
 
+/**
+ * Find the item of a key, or insert the key if it is not in the map. The probe sequence
+ * is walked once, a new key takes the first free or deleted slot on the way.
+ * A frozen map only returns hits, a new key fails with STATIC_MAP_FROZEN instead of STATIC_MAP_FULL
+ * Input: Pointer to a static map instance
+ * Input: The item key
+ * Input: Set to the item of the key, NULL on error
+ * Returns: 1 if the key was inserted, 0 if it was already in the map, or staticMapErr_t
+ */
+int32_t staticMapFindOrInsert(staticMap_t *map, uint32_t key, staticMapItem_t **item);
+
 /**
  * Find an item given the key
  * Input: Pointer to a static map instance
@@ -116,6 +428,8 @@ staticMapItem_t* staticMapFind(staticMap_t *map, uint32_t key);
 
 /**
  * Remove the item from the map given the actuall item
+ * Other entries in the same cluster may move to another slot in the map array,
+ * pointers to the items themselves stay valid
  * Input: Pointer to a static map instance
  * Input: Item to remove
  * Returns: staticMapErr_t
@@ -131,13 +445,374 @@ int32_t staticMapRemove(staticMap_t *map, staticMapItem_t *item);
 int32_t staticMapRemoveByKey(staticMap_t *map, uint32_t key);
 
 /**
- * Loop throug all item in map and call the callback on each
+ * The calls above with a hash the caller already has, such as a NIC RSS hash.
+ * Without STATIC_MAP_STORED_HASH the map hashes keys again whenever entries move,
+ * so the hash must be the one the map computes for the key. With STATIC_MAP_STORED_HASH
+ * the hash is kept in the node and any hash works, as long as a key always gets the same
+ * one. In that case use the hashed calls for every key of the map, the calls that only
+ * take a key hash it with the map hash function. Concurrent readers use staticMapFindConcurrentHashed
+ */
+staticMapItem_t *staticMapFindHashed(staticMap_t *map, uint32_t key, uint32_t hash);
+staticMapItem_t *staticMapInsertAndGetHashed(staticMap_t *map, uint32_t key, uint32_t hash);
+int32_t staticMapFindOrInsertHashed(staticMap_t *map, uint32_t key, uint32_t hash, staticMapItem_t **item);
+int32_t staticMapRemoveByKeyHashed(staticMap_t *map, uint32_t key, uint32_t hash);
+
+#ifndef STATIC_MAP_UNORDERED
+/**
+ * Find an item given the key and mark it as the most recently used.
+ * The item is moved to the head of the list, so the tail is always the least recently used
+ * Input: Pointer to a static map instance
+ * Input: The item key
+ * Returns: An available item or NULL if no item was found
+ */
+staticMapItem_t* staticMapFindAndTouch(staticMap_t *map, uint32_t key);
+
+/**
+ * Insert a key, evicting the least recently used item if the map holds capacity items.
+ * One probe finds a duplicate or places the key, a duplicate evicts nothing.
+ * The eviction callback is called for the evicted item before it is removed, once the removal
+ * can no longer fail. With an items array the new key takes over the struct of the evicted item.
+ * Keep capacity below the map length, a completely full map has to scan every slot on a miss
+ * Input: Pointer to a static map instance
+ * Input: Key to new item
+ * Returns: The new item, or NULL if the key already exists
+ */
+staticMapItem_t *staticMapInsertOrEvict(staticMap_t *map, uint32_t key);
+#endif
+
+#ifdef STATIC_MAP_TTL
+#define STATIC_MAP_NO_DEADLINE 0 // Deadline of an item that never expires, every insert starts with it
+
+/**
+ * Set the expiry deadline of an item and move it to the head of the list.
+ * staticMapExpire works from the tail, so deadlines should be set in increasing order,
+ * for example now + a fixed time to live each time an entry is used.
+ * Time is a free running 32-bit tick count, comparisons handle wrap around.
+ * STATIC_MAP_NO_DEADLINE clears the deadline, a tick count of 0 can not be used as a deadline
+ * Input: Pointer to a static map instance
+ * Input: Item in the map
+ * Input: Deadline
+ * Returns: staticMapErr_t
+ */
+int32_t staticMapSetDeadline(staticMap_t *map, staticMapItem_t *item, uint32_t deadline);
+
+/**
+ * Remove expired items from the oldest end of the list, doing at most budget removals.
+ * Stops at the first item with a deadline that has not expired. Items without a deadline are
+ * stepped over where they are, they keep their place in the list and do not count against the budget.
+ * Every removed item is passed to the eviction callback first
+ * Input: Pointer to a static map instance
+ * Input: Current time
+ * Input: Maximum number of items to remove
+ * Input: Set to the deadline of the oldest remaining item that has one, not written if no
+ *        such item is left. May be NULL
+ * Returns: Number of items removed, or staticMapErr_t
+ */
+int32_t staticMapExpire(staticMap_t *map, uint32_t now, uint32_t budget, uint32_t *next_deadline);
+#endif
+
+/**
+ * Concurrent use: a map initialized with config.concurrent may be read from any number of
+ * threads while a single thread modifies it. Readers never lock, they work like this
+ *
+ *  do {
+ *      seq  = staticMapReadBegin(map);
+ *      item = staticMapFindConcurrent(map, key);
+ *      copy what is needed out of the item
+ *  } while (staticMapReadRetry(map, seq));
+ *
+ * Every change the writer makes bumps the map sequence number, so a retry is needed whenever the
+ * map changed during the read, including the found item being removed and its storage reused.
+ * An item pointer must not be used after the read section it was found in has been validated.
+ * Only staticMapFindConcurrent and staticMapFindConcurrentHashed may be called by readers,
+ * all other calls belong to the writer.
+ * The writer can update item payloads under the same protection with staticMapWriteBegin/End.
+ */
+
+/**
+ * Start a read section, waits while the writer is in the middle of a change
+ * Input: Pointer to a static map instance
+ * Returns: Sequence number to pass to staticMapReadRetry
+ */
+uint32_t staticMapReadBegin(const staticMap_t *map);
+
+/**
+ * End a read section
+ * Input: Pointer to a static map instance
+ * Input: Sequence number from staticMapReadBegin
+ * Returns: true if the map changed during the section and everything read must be discarded
+ */
+bool staticMapReadRetry(const staticMap_t *map, uint32_t seq);
+
+/**
+ * Find a key from a reader thread, must be called inside a read section.
+ * The result is only valid if staticMapReadRetry returns false
+ * Input: Pointer to a static map instance
+ * Input: Key
+ * Returns: Pointer to the item or NULL
+ */
+staticMapItem_t *staticMapFindConcurrent(const staticMap_t *map, uint32_t key);
+
+/**
+ * staticMapFindConcurrent with the hash the key was inserted with, see staticMapFindHashed.
+ * Readers of a map filled through the hashed calls with their own hashes must use this one
+ * Input: Pointer to a static map instance
+ * Input: Key
+ * Input: Hash of the key
+ * Returns: Pointer to the item or NULL
+ */
+staticMapItem_t *staticMapFindConcurrentHashed(const staticMap_t *map, uint32_t key, uint32_t hash);
+
+/**
+ * Start a write section, readers retry until it ends. The map calls that modify the map
+ * do this internally, the writer only needs it to change item payloads. Sections may nest
+ * Input: Pointer to a static map instance
+ */
+void staticMapWriteBegin(staticMap_t *map);
+
+/**
+ * End a write section
+ * Input: Pointer to a static map instance
+ */
+void staticMapWriteEnd(staticMap_t *map);
+
+/**
+ * Find several keys at once. All keys are hashed first and the probes are interleaved,
+ * so the cache misses of different keys overlap. The result is the same as calling
+ * staticMapFind for each key in turn
+ * Input: Pointer to a static map instance
+ * Input: Array of keys
+ * Input: Number of keys
+ * Input: Array of n item pointers, set to the found item or NULL
+ * Returns: Number of keys found, or staticMapErr_t
+ */
+int32_t staticMapFindBatch(staticMap_t *map, const uint32_t *keys, size_t n, staticMapItem_t **out_items);
+
+/**
+ * Insert several keys at once, the keys are hashed and their home slots prefetched
+ * ahead of the inserts. The result is the same as calling staticMapInsertAndGet for
+ * each key in order
+ * Input: Pointer to a static map instance
+ * Input: Array of keys
+ * Input: Number of keys
+ * Input: Array of n item pointers, set to the new item or NULL if the insert failed
+ * Returns: Number of keys inserted, or staticMapErr_t
+ */
+int32_t staticMapInsertBatch(staticMap_t *map, const uint32_t *keys, size_t n, staticMapItem_t **out_items);
+
+/**
+ * Remove several keys at once, the keys are hashed and their home slots prefetched
+ * ahead of the removes. Keys that are not in the map are skipped
+ * Input: Pointer to a static map instance
+ * Input: Array of keys
+ * Input: Number of keys
+ * Returns: Number of keys removed, or staticMapErr_t
+ */
+int32_t staticMapRemoveBatch(staticMap_t *map, const uint32_t *keys, size_t n);
+
+/**
+ * Insert many keys in one pass. Every key is hashed first, then the keys are sorted by
+ * home bucket and placed in that order, so the table is written front to back instead of
+ * at random. The new items are linked into the list in one pass at the end, in the order
+ * they were placed. A running grow is finished first.
+ * Nothing is inserted unless the map has room for all n keys
+ * Input: Pointer to a static map instance
+ * Input: Array of keys
+ * Input: Number of keys
+ * Input: Array of n items, out_items[i] is the item of keys[i] or NULL if the key was not inserted
+ * Input: Scratch array of 2 * n uint32_t
+ * Returns: Number of keys inserted, n minus the number of duplicates, or staticMapErr_t.
+ *          STATIC_MAP_FULL if a cuckoo map could not place every key, the keys that were
+ *          placed stay in the map and have their item in out_items
+ */
+int32_t staticMapBulkInsert(staticMap_t *map, const uint32_t *keys, size_t n, staticMapItem_t **out_items, uint32_t *scratch);
+
+/**
+ * Fill an empty map from an array of keys, see staticMapBulkInsert
+ * Input: Pointer to a static map instance
+ * Input: Array of keys
+ * Input: Number of keys
+ * Input: Array of n items, out_items[i] is the item of keys[i] or NULL if the key was not inserted
+ * Input: Scratch array of 2 * n uint32_t
+ * Returns: Number of keys inserted, or staticMapErr_t
+ */
+int32_t staticMapBuildFrom(staticMap_t *map, const uint32_t *keys, size_t n, staticMapItem_t **out_items, uint32_t *scratch);
+
+/**
+ * Reclaim all tombstones in the map. Removing an item never leaves a tombstone,
+ * so this is only needed for maps that contain slots marked STATIC_MAP_SLOT_DELETED
+ * Input: Pointer to a static map instance
+ * Returns: staticMapErr_t
+ */
+int32_t staticMapCompact(staticMap_t *map);
+
+/**
+ * Buffer size needed by staticMapFreeze for the keys currently in the map
+ * Input: Pointer to a static map instance
+ * Returns: Size in bytes
+ */
+size_t staticMapFreezeSize(const staticMap_t *map);
+
+/**
+ * Make the map read only and build a minimal perfect hash over its keys (hash, displace
+ * and compress). A frozen staticMapFind hashes the key twice, reads one displacement and one
+ * key and slot pair, and compares the key once, no probing. The buffer holds the perfect hash
+ * and must stay valid until the map is unfrozen.
+ * Inserts and removes fail with STATIC_MAP_FROZEN, or NULL, while the map is frozen.
+ * Freezing fails with STATIC_MAP_INVALID_KEY if two keys have the same hash value,
+ * the map is left unfrozen when it fails
+ * Input: Pointer to a static map instance
+ * Input: Buffer, 4 byte aligned
+ * Input: Size of the buffer, at least staticMapFreezeSize
+ * Returns: staticMapErr_t
+ */
+int32_t staticMapFreeze(staticMap_t *map, void *buffer, size_t size);
+
+/**
+ * Drop the perfect hash and allow changes again, the buffer belongs to the caller afterwards
+ * Input: Pointer to a static map instance
+ * Returns: staticMapErr_t
+ */
+int32_t staticMapUnfreeze(staticMap_t *map);
+
+/**
+ * Start growing the map into new caller provided storage. Nothing is copied up front,
+ * every insert and remove after this moves STATIC_MAP_GROW_STEP slots of the old table
+ * and staticMapGrowStep moves more. Lookups check both tables until the old one is empty,
+ * then its storage belongs to the caller again.
+ * Migrated entries are copied into the new storage, whole user structs with their data,
+ * so item pointers are only valid until the next insert or remove while the grow runs.
+ * The map must have been initialized with a config, STATIC_MAP_INIT or as a strided map so the
+ * node offset is known, a map from staticMapInit is refused unless its items are bare nodes.
+ * Only ordered maps with pointer nodes can grow, and not while they are concurrent or process shared
+ * Input: Pointer to a static map instance
+ * Input: New array of new_length item pointers, NULL for a strided table
+ * Input: New number of items, larger than the current length
+ * Input: First of new_length items of the same size as the current ones
+ * Input: Optional STATIC_MAP_CTRL_BYTES(new_length) control bytes for the new table
+ * Returns: staticMapErr_t
+ */
+int32_t staticMapGrowBegin(staticMap_t *map, staticMapItem_t **new_items, size_t new_length,
+                           staticMapItem_t *new_first_item, uint8_t *new_ctrl);
+
+/**
+ * Move more of the old table into the new one
+ * Input: Pointer to a static map instance
+ * Input: Number of old slots to migrate
+ * Returns: Number of entries left in the old table, 0 once the grow is done, or staticMapErr_t
+ */
+int32_t staticMapGrowStep(staticMap_t *map, uint32_t budget);
+
+/**
+ * Loop throug all item in map and call the callback on each.
+ * Items are visited oldest first, or in slot order in an unordered map
  * Input: Pointer to a static map instance
  * Input: Callback function
  * Returns: staticMapErr_t
  */
 int32_t staticMapForEach(staticMap_t *map, int32_t (*callback)(staticMap_t *map, staticMapItem_t *item));
 
+/**
+ * Iterator over the items in a map, in the same order as staticMapForEach.
+ * The calls are inlined, so a loop over the map has no indirect calls.
+ * The current item may be erased with staticMapIterErase, any other change
+ * to the map during the loop is not allowed
+ */
+typedef struct {
+    staticMap_t     *map;
+    staticMapItem_t *item; // Current item, NULL when the loop is done or the item was erased
+#ifndef STATIC_MAP_UNORDERED
+    staticMapItem_t *next; // Read ahead so the current item can be erased
+#else
+    uint32_t         index;  // Slot of the current item
+    bool             erased; // Items were erased, the map is compacted when the loop ends
+#endif
+} staticMapIter_t;
+
+#ifndef STATIC_MAP_UNORDERED
+
+/**
+ * Start iterating
+ * Input: Pointer to a static map instance
+ * Input: Iterator
+ * Returns: The first item, NULL if the map is empty
+ */
+static inline staticMapItem_t *staticMapIterFirst(staticMap_t *map, staticMapIter_t *iter) {
+    iter->map  = map;
+    iter->item = map->tail;
+    iter->next = iter->item != NULL ? staticMapItemNext(map, iter->item) : NULL;
+    return iter->item;
+}
+
+/**
+ * Step to the next item
+ * Input: Iterator
+ * Returns: The next item, NULL at the end of the map
+ */
+static inline staticMapItem_t *staticMapIterNext(staticMapIter_t *iter) {
+    iter->item = iter->next;
+    iter->next = iter->item != NULL ? staticMapItemNext(iter->map, iter->item) : NULL;
+    return iter->item;
+}
+#else
+// Find the next slot in use from iter->index
+static inline staticMapItem_t *staticMapIterScan(staticMapIter_t *iter) {
+    staticMap_t *map = iter->map;
+
+    for (; iter->index < map->length; iter->index++) {
+        staticMapItem_t *item = staticMapSlotItem(map, iter->index);
+        if (staticMapItemState(item) == STATIC_MAP_SLOT_IN_USE) {
+            iter->item = item;
+            return item;
+        }
+    }
+
+    // Erased slots were left as tombstones so nothing moved during the loop, reclaim them now
+    if (iter->erased) {
+        iter->erased = false;
+        staticMapCompact(map);
+    }
+
+    iter->item = NULL;
+    return NULL;
+}
+
+static inline staticMapItem_t *staticMapIterFirst(staticMap_t *map, staticMapIter_t *iter) {
+    iter->map    = map;
+    iter->index  = 0;
+    iter->erased = false;
+    return staticMapIterScan(iter);
+}
+
+static inline staticMapItem_t *staticMapIterNext(staticMapIter_t *iter) {
+    iter->index++;
+    return staticMapIterScan(iter);
+}
+#endif
+
+/**
+ * Remove the current item from the map, the loop continues with the next item.
+ * In an unordered map the slot is reclaimed when the loop reaches the end,
+ * after a break staticMapCompact can be called to do it
+ * Input: Iterator
+ * Returns: staticMapErr_t
+ */
+int32_t staticMapIterErase(staticMapIter_t *iter);
+
+/**
+ * Loop over every item in the map, break works as usual
+ *
+ *  staticMapIter_t iter;
+ *  STATIC_MAP_FOREACH(&my_map, iter, item) {
+ *      myItem_t *my_item = CONTAINER_OF(item, myItem_t, node);
+ *      if (my_item->data == 0) {
+ *          staticMapIterErase(&iter);
+ *      }
+ *  }
+ */
+#define STATIC_MAP_FOREACH(map, iter, item) \
+    for (staticMapItem_t *item = staticMapIterFirst((map), &(iter)); item != NULL; item = staticMapIterNext(&(iter)))
+
 /**
  * Get the number of items in the map
  * Input: Pointer to a static map instance
@@ -146,9 +821,131 @@ int32_t staticMapForEach(staticMap_t *map, int32_t (*callback)(staticMap_t *map,
 int32_t staticMapGetNumItems(staticMap_t *map);
 
 /**
- * This is a macro that makes it more safe to initialize a static map
+ * Get statistics for the map. This walks every slot, so it is meant for monitoring
+ * and sizing, not for the hot path. Operation counters are included when the map
+ * is built with STATIC_MAP_STATS
+ * Input: Pointer to a static map instance
+ * Input: Pointer to the stats to fill in
+ * Returns: staticMapErr_t
+ */
+int32_t staticMapGetStats(staticMap_t *map, staticMapStats_t *stats);
+
+/**
+ * Clear the operation counters, does nothing unless built with STATIC_MAP_STATS
+ * Input: Pointer to a static map instance
+ * Returns: staticMapErr_t
+ */
+int32_t staticMapResetStats(staticMap_t *map);
+
+/**
+ * Size of the image staticMapSnapshot writes for this map
+ * Input: Pointer to a static map instance
+ * Returns: Size in bytes, 0 on error
+ */
+size_t staticMapSnapshotSize(staticMap_t *map);
+
+/**
+ * Write a position independent image of the map: slot states, keys, list order, ctrl bytes and
+ * the whole user struct of every slot, stored in slot order with list links stored as slot indices.
+ * The image can be written to a file and attached to with staticMapLoad after a restart.
+ * The image is only valid on a machine with the same byte order and the same map build options.
+ * The map must have been initialized with a config, STATIC_MAP_INIT or as a strided map so the
+ * node offset is known, a map from staticMapInit is refused unless its items are bare nodes.
+ * The buffer may be the image a map was loaded from, this brings the image up to date in place.
+ * Without STATIC_MAP_COMPACT_NODE the links of such a map are turned back into slot indices,
+ * so it must be loaded again before it is used
+ * Input: Pointer to a static map instance
+ * Input: Buffer for the image, 8 byte aligned
+ * Input: Size of the buffer, at least staticMapSnapshotSize
+ * Returns: staticMapErr_t, STATIC_MAP_FULL if the buffer is too small,
+ *          STATIC_MAP_INVALID_CONFIG if the node offset is unknown or the map is growing
+ */
+int32_t staticMapSnapshot(staticMap_t *map, void *buffer, size_t size);
+
+/**
+ * Attach a map to an image written by staticMapSnapshot, typically a file mapped with mmap.
+ * No item is inserted or copied, the map becomes a strided map that uses the image as its storage,
+ * so changes are written to the image. With STATIC_MAP_COMPACT_NODE the links are already slot
+ * indices and nothing is touched at load, otherwise one pass converts the list links to pointers.
+ * The hash function is not part of the image, the config must give the one the map was built with.
+ * Probe scheme and seed come from the image.
+ * The image header keeps the count and list ends of the snapshot and, without STATIC_MAP_COMPACT_NODE,
+ * the links hold pointers of this process after load. An image that is changed through the map is only
+ * valid again after staticMapSnapshot has been called on it, so a file mapped MAP_SHARED must be
+ * snapshotted in place before it is unmapped, otherwise map it MAP_PRIVATE or load a copy
+ * Input: Pointer to a static map instance
+ * Input: The image, 8 byte aligned and writable
+ * Input: Size of the image
+ * Input: Hash, capacity, eviction and concurrency settings, NULL gives the defaults
+ * Returns: staticMapErr_t, STATIC_MAP_INVALID_IMAGE if the image does not match this build
+ */
+int32_t staticMapLoad(staticMap_t *map, void *image, size_t size, const staticMapConfig_t *config);
+
+/**
+ * Process shared maps: the header, items and control bytes live in one region, for example
+ * a shm segment, and every link is a slot index, so each process may map it at any address.
+ * One process creates the map and is the only writer, the others attach and look up keys
+ * with staticMapFindConcurrent inside staticMapReadBegin/staticMapReadRetry, straight from
+ * the shared memory. The region uses the snapshot image layout, so it can also be saved and
+ * loaded with staticMapLoad. Needs STATIC_MAP_COMPACT_NODE or STATIC_MAP_UNORDERED, pointer
+ * links can not be shared
+ */
+
+/**
+ * Size of a shared region
+ * Input: Number of items
+ * Input: Size of each item
+ * Input: true to keep control bytes in the region
+ * Returns: Size in bytes
+ */
+size_t staticMapSharedSize(size_t length, size_t item_size, bool ctrl);
+
+/**
+ * Create a map in a shared region, the map instance is the writer view of it.
+ * The item structs are stored in the region, the node is at node_offset in each
+ * Input: Pointer to a static map instance
+ * Input: The region, 8 byte aligned
+ * Input: Size of the region, at least staticMapSharedSize
+ * Input: Number of items
+ * Input: Size of each item
+ * Input: Offset of the staticMapItem_t in the user struct
+ * Input: true to keep control bytes in the region
+ * Input: Map configuration, NULL gives the default map. The ctrl array is ignored
+ * Returns: staticMapErr_t
+ */
+int32_t staticMapSharedCreate(staticMap_t *map, void *region, size_t size, size_t length, size_t item_size,
+                              size_t node_offset, bool ctrl, const staticMapConfig_t *config);
+
+/**
+ * Attach a map instance to a shared region created by another process. A process that takes
+ * over as the writer attaches the same way
+ * Input: Pointer to a static map instance
+ * Input: The region as mapped in this process
+ * Input: Size of the region
+ * Input: Hash function and other local settings, must use the same hash as the creator
+ * Returns: staticMapErr_t
+ */
+int32_t staticMapSharedAttach(staticMap_t *map, void *region, size_t size, const staticMapConfig_t *config);
+
+/**
+ * Detach a map instance from its shared region, the caller unmaps the region afterwards
+ * Input: Pointer to a static map instance
+ * Returns: staticMapErr_t
+ */
+int32_t staticMapSharedDetach(staticMap_t *map);
+
+/**
+ * This is a macro that makes it more safe to initialize a static map.
+ * It also sets the node offset, so grow and snapshots copy whole user structs
  */
 #define STATIC_MAP_INIT(map, array, length, list) \
-    staticMapInit(&(map), &((array)[0]), (length), sizeof((list)[0]), &list->node);
+    staticMapInitWithConfig(&(map), &((array)[0]), (length), sizeof((list)[0]), &(list)[0].node, \
+                            &(staticMapConfig_t){.node_offset = (size_t)((uint8_t *)&(list)[0].node - (uint8_t *)&(list)[0])})
+
+/**
+ * Helper macro for strided maps, list is an array of user structs with the node in member
+ */
+#define STATIC_MAP_INIT_STRIDED(map, length, list, member, config) \
+    staticMapInitStrided(&(map), (length), sizeof((list)[0]), &(list)[0].member, (size_t)((uint8_t *)&(list)[0].member - (uint8_t *)&(list)[0]), (config))
 
 #endif /* STATIC_MAP_H */
\ No newline at end of file
@@ -0,0 +1,43 @@
+/**
+ * @file:       static_map_internal.h
+ * @author:     Lucas Wennerholm <lucas.wennerholm@gmail.com>
+ * @brief:      Calls shared by the static map modules, not part of the public API
+ *
+ * @license: MIT License
+ *
+ * Copyright (c) 2025 Lucas Wennerholm
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#ifndef STATIC_MAP_INTERNAL_H
+#define STATIC_MAP_INTERNAL_H
+
+#include "static_map.h"
+
+/**
+ * The walk behind staticMapForEach, for modules that walk several maps in a row
+ * Input: Pointer to a static map instance
+ * Input: Callback function
+ * Input: Set to true if the callback or an erase ended the walk early
+ * Returns: staticMapErr_t
+ */
+int32_t staticMapForEachWalk(staticMap_t *map, int32_t (*callback)(staticMap_t *map, staticMapItem_t *item), bool *stop);
+
+#endif /* STATIC_MAP_INTERNAL_H */
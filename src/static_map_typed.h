@@ -0,0 +1,223 @@
+/**
+ * @file:       static_map_typed.h
+ * @author:     Lucas Wennerholm <lucas.wennerholm@gmail.com>
+ * @brief:      Type specialized static maps generated at compile time
+ *
+ * @license: MIT License
+ *
+ * Copyright (c) 2025 Lucas Wennerholm
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * STATIC_MAP_DEFINE(name, item_t, member, key_t, hash, eq, capacity) generates a map type
+ * name_t that owns capacity items of type item_t, where item_t->member holds the key.
+ * Every function is static inline and specialized for the key type:
+ *
+ *  void     name_init(name_t *map);
+ *  item_t  *name_find(name_t *map, key_t key);
+ *  item_t  *name_insert(name_t *map, key_t key);       NULL if the key exists or the map is full
+ *  int32_t  name_remove(name_t *map, key_t key);       staticMapErr_t
+ *  int32_t  name_remove_item(name_t *map, item_t *item);
+ *  uint32_t name_count(const name_t *map);
+ *
+ * hash(key) returns a well mixed uint32_t and eq(a, b) returns true for equal keys.
+ * The capacity must be a power of two, the mask is a compile time constant.
+ * Like staticMap_t the items never move, slots hold pointers that are swapped on removal.
+ *
+ * Example, a flow table keyed on a 5-tuple:
+ *
+ *  STATIC_MAP_BYTES_KEY(flowKey, 13)
+ *  typedef struct { flowKey_t key; uint32_t packets; } flow_t;
+ *  STATIC_MAP_DEFINE(flowMap, flow_t, key, flowKey_t, flowKey_hash, flowKey_eq, 1024)
+ *  static flowMap_t flows;
+ */
+
+#ifndef STATIC_MAP_TYPED_H
+#define STATIC_MAP_TYPED_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "static_map.h"
+
+/**
+ * Murmur3 64-bit finalizer folded to 32 bits, every key bit affects every hash bit
+ * Input: The key
+ * Returns: The hash
+ */
+static inline uint32_t staticMapHashU64(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return (uint32_t)key ^ (uint32_t)(key >> 32);
+}
+
+static inline bool staticMapEqU64(uint64_t a, uint64_t b) {
+    return a == b;
+}
+
+/**
+ * FNV-1a over a byte string with a murmur3 finalizer. With a constant length the loop unrolls
+ * Input: Pointer to the bytes
+ * Input: Number of bytes
+ * Returns: The hash
+ */
+static inline uint32_t staticMapHashBytes(const void *data, size_t len) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ bytes[i]) * 16777619u;
+    }
+
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+/**
+ * Declare a fixed length byte key, such as a MAC address or a packed 5-tuple.
+ * Generates the type name_t and the helpers name_hash and name_eq for STATIC_MAP_DEFINE
+ */
+#define STATIC_MAP_BYTES_KEY(name, len)                                             \
+    typedef struct {                                                                \
+        uint8_t bytes[len];                                                         \
+    } name##_t;                                                                     \
+                                                                                    \
+    static inline uint32_t name##_hash(name##_t key) {                              \
+        return staticMapHashBytes(key.bytes, len);                                  \
+    }                                                                               \
+                                                                                    \
+    static inline bool name##_eq(name##_t a, name##_t b) {                          \
+        return memcmp(a.bytes, b.bytes, len) == 0;                                  \
+    }
+
+#define STATIC_MAP_DEFINE(name, item_t, member, key_t, hash, eq, capacity)           \
+    /* Fails to compile unless the capacity is a power of two */                    \
+    typedef char name##_capacity_check[                                             \
+        ((capacity) > 1 && ((capacity) & ((capacity) - 1)) == 0) ? 1 : -1];         \
+                                                                                    \
+    enum { name##_CAPACITY = (capacity), name##_MASK = (capacity) - 1 };            \
+                                                                                    \
+    typedef struct {                                                                \
+        item_t  *slots[capacity];  /* Slot to item, swapped to move entries */      \
+        uint8_t  in_use[capacity]; /* Slot state, no tombstones are kept */         \
+        uint32_t count;                                                             \
+        item_t   storage[capacity];                                                 \
+    } name##_t;                                                                     \
+                                                                                    \
+    static inline void name##_init(name##_t *map) {                                 \
+        for (uint32_t i = 0; i < name##_CAPACITY; i++) {                            \
+            map->slots[i]  = &map->storage[i];                                      \
+            map->in_use[i] = 0;                                                     \
+        }                                                                           \
+        map->count = 0;                                                             \
+    }                                                                               \
+                                                                                    \
+    /* Index of the key, or of the empty slot that ends its probe */                \
+    static inline uint32_t name##_probe(name##_t *map, key_t key, bool *found) {    \
+        uint32_t index = (uint32_t)hash(key) & name##_MASK;                         \
+        for (uint32_t attempt = 0; attempt < name##_CAPACITY; attempt++) {          \
+            if (!map->in_use[index]) {                                              \
+                *found = false;                                                     \
+                return index;                                                       \
+            }                                                                       \
+            if (eq(map->slots[index]->member, key)) {                               \
+                *found = true;                                                      \
+                return index;                                                       \
+            }                                                                       \
+            index = (index + 1) & name##_MASK;                                      \
+        }                                                                           \
+        *found = false;                                                             \
+        return name##_CAPACITY;                                                     \
+    }                                                                               \
+                                                                                    \
+    static inline item_t *name##_find(name##_t *map, key_t key) {                   \
+        bool found;                                                                 \
+        uint32_t index = name##_probe(map, key, &found);                            \
+        return found ? map->slots[index] : NULL;                                    \
+    }                                                                               \
+                                                                                    \
+    static inline item_t *name##_insert(name##_t *map, key_t key) {                 \
+        bool found;                                                                 \
+        uint32_t index = name##_probe(map, key, &found);                            \
+        if (found || index == name##_CAPACITY) {                                    \
+            return NULL;                                                            \
+        }                                                                           \
+        map->in_use[index] = 1;                                                     \
+        map->slots[index]->member = key;                                            \
+        map->count++;                                                               \
+        return map->slots[index];                                                   \
+    }                                                                               \
+                                                                                    \
+    /* Empty the slot and pull the rest of the cluster back, see backwardShift */   \
+    static inline void name##_remove_at(name##_t *map, uint32_t hole) {             \
+        map->in_use[hole] = 0;                                                      \
+        map->count--;                                                               \
+        uint32_t index = (hole + 1) & name##_MASK;                                  \
+        while (map->in_use[index]) {                                                \
+            uint32_t home = (uint32_t)hash(map->slots[index]->member) & name##_MASK;\
+            if (((index - home) & name##_MASK) >= ((index - hole) & name##_MASK)) { \
+                item_t *tmp        = map->slots[hole];                              \
+                map->slots[hole]   = map->slots[index];                             \
+                map->slots[index]  = tmp;                                           \
+                map->in_use[hole]  = 1;                                             \
+                map->in_use[index] = 0;                                             \
+                hole = index;                                                       \
+            }                                                                       \
+            index = (index + 1) & name##_MASK;                                      \
+        }                                                                           \
+    }                                                                               \
+                                                                                    \
+    static inline int32_t name##_remove(name##_t *map, key_t key) {                 \
+        bool found;                                                                 \
+        uint32_t index = name##_probe(map, key, &found);                            \
+        if (!found) {                                                               \
+            return STATIC_MAP_UNUSED_ERASE;                                         \
+        }                                                                           \
+        name##_remove_at(map, index);                                               \
+        return STATIC_MAP_SUCCESS;                                                  \
+    }                                                                               \
+                                                                                    \
+    static inline int32_t name##_remove_item(name##_t *map, item_t *item) {         \
+        if (item == NULL) {                                                         \
+            return STATIC_MAP_NULL_ERROR;                                           \
+        }                                                                           \
+        bool found;                                                                 \
+        uint32_t index = name##_probe(map, item->member, &found);                   \
+        if (!found || map->slots[index] != item) {                                  \
+            return STATIC_MAP_UNUSED_ERASE;                                         \
+        }                                                                           \
+        name##_remove_at(map, index);                                               \
+        return STATIC_MAP_SUCCESS;                                                  \
+    }                                                                               \
+                                                                                    \
+    static inline uint32_t name##_count(const name##_t *map) {                      \
+        return map->count;                                                          \
+    }
+
+#endif /* STATIC_MAP_TYPED_H */
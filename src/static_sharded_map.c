@@ -0,0 +1,145 @@
+/**
+ * @file:       static_sharded_map.c
+ * @author:     Lucas Wennerholm <lucas.wennerholm@gmail.com>
+ * @brief:      Static maps split into independent shards, one per core
+ *
+ * @license: MIT License
+ *
+ * Copyright (c) 2025 Lucas Wennerholm
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include "static_sharded_map.h"
+#include "static_map_internal.h"
+#include <string.h>
+
+// splitmix32 style finalizer. The shards default to the murmur3 finalizer, so keys
+// routed to one shard still spread over all of its buckets and control byte tags
+static inline uint32_t routeMix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x7feb352dU;
+    h ^= h >> 15;
+    h *= 0x846ca68bU;
+    h ^= h >> 16;
+    return h;
+}
+
+// Uninitialized shards have no storage and hold no keys
+static inline staticMap_t *ownerShard(staticShardedMap_t *sharded, uint32_t key) {
+    staticMap_t *map = &sharded->shards[staticShardedMapShardOf(sharded, key)].map;
+    return map->length != 0 ? map : NULL;
+}
+
+int32_t staticShardedMapInit(staticShardedMap_t *sharded, staticShardedMapShard_t *shards, uint32_t num_shards,
+                             staticMapHash_t route, uint32_t route_seed) {
+    if (sharded == NULL || shards == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    // A misaligned array would let neighbouring shards share a line
+    if (num_shards == 0 || (uintptr_t)shards % STATIC_SHARDED_MAP_CACHE_LINE != 0) {
+        return STATIC_MAP_INVALID_CONFIG;
+    }
+
+    memset(shards, 0, (size_t)num_shards * sizeof(staticShardedMapShard_t));
+
+    sharded->shards     = shards;
+    sharded->num_shards = num_shards;
+    sharded->route      = route;
+    sharded->route_seed = route_seed;
+
+    return STATIC_MAP_SUCCESS;
+}
+
+int32_t staticShardedMapInitShard(staticShardedMap_t *sharded, uint32_t shard, staticMapItem_t **itemsArray, size_t length,
+                                  size_t item_size, staticMapItem_t *first_item, const staticMapConfig_t *config) {
+    if (sharded == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    if (shard >= sharded->num_shards) {
+        return STATIC_MAP_INVALID_CONFIG;
+    }
+
+    return staticMapInitWithConfig(&sharded->shards[shard].map, itemsArray, length, item_size, first_item, config);
+}
+
+uint32_t staticShardedMapShardOf(const staticShardedMap_t *sharded, uint32_t key) {
+    uint32_t hash = sharded->route != NULL ? sharded->route(key, sharded->route_seed) : routeMix(key ^ sharded->route_seed);
+
+    // Multiply shift range reduction, any shard count works without a division
+    return (uint32_t)(((uint64_t)hash * sharded->num_shards) >> 32);
+}
+
+staticMapItem_t *staticShardedMapFind(staticShardedMap_t *sharded, uint32_t key) {
+    if (sharded == NULL) {
+        return NULL;
+    }
+
+    staticMap_t *map = ownerShard(sharded, key);
+    return map != NULL ? staticMapFind(map, key) : NULL;
+}
+
+staticMapItem_t *staticShardedMapInsertAndGet(staticShardedMap_t *sharded, uint32_t key) {
+    if (sharded == NULL) {
+        return NULL;
+    }
+
+    staticMap_t *map = ownerShard(sharded, key);
+    return map != NULL ? staticMapInsertAndGet(map, key) : NULL;
+}
+
+int32_t staticShardedMapRemoveByKey(staticShardedMap_t *sharded, uint32_t key) {
+    if (sharded == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    staticMap_t *map = ownerShard(sharded, key);
+    return map != NULL ? staticMapRemoveByKey(map, key) : STATIC_MAP_UNUSED_ERASE;
+}
+
+int32_t staticShardedMapForEach(staticShardedMap_t *sharded, int32_t (*callback)(staticMap_t *map, staticMapItem_t *item)) {
+    if (sharded == NULL || callback == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    int32_t result = STATIC_MAP_SUCCESS;
+    bool stop = false;
+
+    // A stop in one shard ends the whole loop
+    for (uint32_t shard = 0; shard < sharded->num_shards && !stop; shard++) {
+        result = staticMapForEachWalk(&sharded->shards[shard].map, callback, &stop);
+    }
+
+    return result;
+}
+
+int32_t staticShardedMapGetNumItems(staticShardedMap_t *sharded) {
+    if (sharded == NULL) {
+        return STATIC_MAP_NULL_ERROR;
+    }
+
+    int32_t total = 0;
+    for (uint32_t shard = 0; shard < sharded->num_shards; shard++) {
+        total += staticMapGetNumItems(&sharded->shards[shard].map);
+    }
+
+    return total;
+}
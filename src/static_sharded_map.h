@@ -0,0 +1,164 @@
+/**
+ * @file:       static_sharded_map.h
+ * @author:     Lucas Wennerholm <lucas.wennerholm@gmail.com>
+ * @brief:      Static maps split into independent shards, one per core
+ *
+ * @license: MIT License
+ *
+ * Copyright (c) 2025 Lucas Wennerholm
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * A sharded map routes every key to one of N independent staticMap_t shards.
+ * Each shard has its own header on its own cache lines and its own item storage,
+ * so a core that owns a shard never writes a line that another shard uses.
+ *
+ * The router hashes the key with a function separate from the shard hash, the
+ * shard still sees the full spread of its own hash. staticShardedMapInit sets up
+ * the routing, then every shard is initialized with staticShardedMapInitShard,
+ * typically by the core that owns it so that the storage is touched on its own node:
+ *
+ *  static staticShardedMapShard_t shards[NUM_CORES];
+ *  static staticShardedMap_t flows;
+ *
+ *  staticShardedMapInit(&flows, shards, NUM_CORES, NULL, 0);
+ *  // On each core
+ *  staticShardedMapInitShard(&flows, core, local_array, LENGTH, sizeof(flow_t), &local_flows[0].node, NULL);
+ *
+ * The shards follow the rules of staticMap_t, only the owner of a shard may change it.
+ */
+
+#ifndef STATIC_SHARDED_MAP_H
+#define STATIC_SHARDED_MAP_H
+
+#include "static_map.h"
+
+#define STATIC_SHARDED_MAP_CACHE_LINE 64
+
+// Whole cache lines for one shard header
+#define STATIC_SHARDED_MAP_SHARD_SIZE \
+    ((sizeof(staticMap_t) + STATIC_SHARDED_MAP_CACHE_LINE - 1) / STATIC_SHARDED_MAP_CACHE_LINE * STATIC_SHARDED_MAP_CACHE_LINE)
+
+#if defined(__GNUC__)
+#define STATIC_SHARDED_MAP_ALIGNED __attribute__((aligned(STATIC_SHARDED_MAP_CACHE_LINE)))
+#else
+#define STATIC_SHARDED_MAP_ALIGNED
+#endif
+
+/**
+ * One shard, padded so that no two shard headers share a cache line.
+ * Arrays of shards must start on a cache line, staticShardedMapInit checks it
+ */
+typedef union {
+    staticMap_t map;
+    uint8_t     pad[STATIC_SHARDED_MAP_SHARD_SIZE];
+} STATIC_SHARDED_MAP_ALIGNED staticShardedMapShard_t;
+
+/**
+ * The router, only read after init so every core can keep it in its cache
+ */
+typedef struct {
+    staticShardedMapShard_t *shards;
+    uint32_t                 num_shards;
+    staticMapHash_t          route;      // NULL selects the built in router
+    uint32_t                 route_seed;
+} staticShardedMap_t;
+
+/**
+ * Set up the routing over an array of shards, every shard starts out empty with no storage
+ * Input: Pointer to a sharded map instance
+ * Input: Array of num_shards shards, cache line aligned
+ * Input: Number of shards
+ * Input: Routing hash, must differ from the shard hash. NULL selects a mixer independent of staticMapHashMix32
+ * Input: Seed for the routing hash
+ * Returns: staticMapErr_t
+ */
+int32_t staticShardedMapInit(staticShardedMap_t *sharded, staticShardedMapShard_t *shards, uint32_t num_shards,
+                             staticMapHash_t route, uint32_t route_seed);
+
+/**
+ * Give a shard its storage, see staticMapInitWithConfig. For a strided shard
+ * call staticMapInitStrided on staticShardedMapShard instead
+ * Input: Pointer to a sharded map instance
+ * Input: Shard index
+ * Input: Items array of the shard
+ * Input: Number of items in the shard
+ * Input: Size of the user struct
+ * Input: Pointer to the node in the first user struct
+ * Input: Shard configuration, or NULL for the default map
+ * Returns: staticMapErr_t
+ */
+int32_t staticShardedMapInitShard(staticShardedMap_t *sharded, uint32_t shard, staticMapItem_t **itemsArray, size_t length,
+                                  size_t item_size, staticMapItem_t *first_item, const staticMapConfig_t *config);
+
+/**
+ * The shard that owns a key
+ * Input: Pointer to a sharded map instance
+ * Input: Key
+ * Returns: Shard index
+ */
+uint32_t staticShardedMapShardOf(const staticShardedMap_t *sharded, uint32_t key);
+
+/**
+ * Get the map of a shard
+ * Input: Pointer to a sharded map instance
+ * Input: Shard index
+ * Returns: The shard map, NULL if the index is out of range
+ */
+static inline staticMap_t *staticShardedMapShard(staticShardedMap_t *sharded, uint32_t shard) {
+    return shard < sharded->num_shards ? &sharded->shards[shard].map : NULL;
+}
+
+/**
+ * Get the map of the shard that owns a key
+ * Input: Pointer to a sharded map instance
+ * Input: Key
+ * Returns: The shard map
+ */
+static inline staticMap_t *staticShardedMapRoute(staticShardedMap_t *sharded, uint32_t key) {
+    return &sharded->shards[staticShardedMapShardOf(sharded, key)].map;
+}
+
+/**
+ * Find, insert or remove a key in the shard that owns it, see the staticMap_t calls
+ */
+staticMapItem_t *staticShardedMapFind(staticShardedMap_t *sharded, uint32_t key);
+staticMapItem_t *staticShardedMapInsertAndGet(staticShardedMap_t *sharded, uint32_t key);
+int32_t staticShardedMapRemoveByKey(staticShardedMap_t *sharded, uint32_t key);
+
+/**
+ * Call the callback on every item of every shard, shard by shard, see staticMapForEach.
+ * The callback gets the shard map of the item. STATIC_MAP_CB_STOP ends the whole loop.
+ * For a single shard call staticMapForEach on staticShardedMapShard
+ * Input: Pointer to a sharded map instance
+ * Input: Callback function
+ * Returns: staticMapErr_t
+ */
+int32_t staticShardedMapForEach(staticShardedMap_t *sharded, int32_t (*callback)(staticMap_t *map, staticMapItem_t *item));
+
+/**
+ * Get the number of items in all shards. Counts of shards owned by other cores may be stale
+ * Input: Pointer to a sharded map instance
+ * Returns: Number of items, STATIC_MAP_NULL_ERROR on error
+ */
+int32_t staticShardedMapGetNumItems(staticShardedMap_t *sharded);
+
+#endif /* STATIC_SHARDED_MAP_H */
@@ -1,5 +1,11 @@
 #include "static_map.h"
+#include "static_map_typed.h"
+#include "static_sharded_map.h"
+#include "static_dense_map.h"
 #include <stdio.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #define NUM_ITEMS_IN_MAP 10
 #define FIRST_ITEM 25
@@ -79,6 +85,2246 @@ static int32_t mapItemEraseCb(staticMap_t *map, staticMapItem_t *map_item) {
     return STATIC_MAP_CB_NEXT;
 }
 
+#define CHURN_ITEMS_IN_MAP 16
+#define CHURN_ROUNDS 1000
+
+staticMap_t churn_map = {0};
+staticMapItem_t * churn_array[CHURN_ITEMS_IN_MAP];
+myItem_t churn_item_map[CHURN_ITEMS_IN_MAP];
+
+static uint32_t countSlotsInState(staticMap_t *map, staticMapslotState_t state) {
+    uint32_t count = 0;
+    for (size_t i = 0; i < map->length; i++) {
+        if (staticMapItemState(staticMapSlotItem(map, i)) == state) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static int testRemoveLeavesNoTombstones(void) {
+    int32_t result = STATIC_MAP_INIT(churn_map, churn_array, CHURN_ITEMS_IN_MAP, churn_item_map);
+    if (result != STATIC_MAP_SUCCESS) {
+        printf("Test failed: Churn map init failed\n");
+        return 1;
+    }
+
+    // Keep the map at 75% load and replace the oldest entry each round
+    uint32_t oldest = 0;
+    uint32_t next_key = 0;
+    for (; next_key < 12; next_key++) {
+        if (insertDataItem(&churn_map, next_key, next_key * CHURN_ITEMS_IN_MAP) == NULL) {
+            printf("Test failed: Churn insert of %u failed\n", next_key);
+            return 1;
+        }
+    }
+
+    for (uint32_t round = 0; round < CHURN_ROUNDS; round++) {
+        if (removeItemByKey(&churn_map, oldest * CHURN_ITEMS_IN_MAP) != STATIC_MAP_SUCCESS) {
+            printf("Test failed: Churn remove of %u failed\n", oldest);
+            return 1;
+        }
+        oldest++;
+
+        if (insertDataItem(&churn_map, next_key, next_key * CHURN_ITEMS_IN_MAP) == NULL) {
+            printf("Test failed: Churn insert of %u failed\n", next_key);
+            return 1;
+        }
+        next_key++;
+
+        if (countSlotsInState(&churn_map, STATIC_MAP_SLOT_DELETED) != 0) {
+            printf("Test failed: Tombstones left after remove in round %u\n", round);
+            return 1;
+        }
+    }
+
+    // Every live key must still be reachable, and removed keys must not be
+    for (uint32_t key = 0; key < next_key; key++) {
+        myItem_t *item = findItem(&churn_map, key * CHURN_ITEMS_IN_MAP);
+        if ((key >= oldest) != (item != NULL) || (item != NULL && item->data != key)) {
+            printf("Test failed: Churn lookup of %u is wrong\n", key);
+            return 1;
+        }
+    }
+    printf("Test passed: Remove leaves no tombstones under churn\n");
+
+#if !defined(STATIC_MAP_UNORDERED) && !defined(STATIC_MAP_COMPACT_NODE)
+    // Plant a tombstone at the start of a cluster and let compact reclaim it
+    myItem_t *first = insertDataItem(&churn_map, 1, 1);
+    myItem_t *second = insertDataItem(&churn_map, 2, 1 + CHURN_ITEMS_IN_MAP);
+    if (first == NULL || second == NULL) {
+        printf("Test failed: Colliding insert failed\n");
+        return 1;
+    }
+
+    // This is what a remove used to do, unlink and mark the slot deleted
+    first->node.prev->next = &second->node;
+    second->node.prev = first->node.prev;
+    first->node.next = NULL;
+    first->node.prev = NULL;
+    first->node.state = STATIC_MAP_SLOT_DELETED;
+
+    result = staticMapCompact(&churn_map);
+    if (result != STATIC_MAP_SUCCESS || countSlotsInState(&churn_map, STATIC_MAP_SLOT_DELETED) != 0) {
+        printf("Test failed: Compact left tombstones behind\n");
+        return 1;
+    }
+
+    if (findItem(&churn_map, 1 + CHURN_ITEMS_IN_MAP) != second || findItem(&churn_map, 1) != NULL) {
+        printf("Test failed: Lookup after compact is wrong\n");
+        return 1;
+    }
+    printf("Test passed: Compact reclaims tombstones\n");
+#endif
+
+    return 0;
+}
+
+#define RH_ITEMS_IN_MAP 64
+#define RH_NUM_KEYS 56
+
+staticMap_t rh_map = {0};
+staticMapItem_t * rh_array[RH_ITEMS_IN_MAP];
+myItem_t rh_item_map[RH_ITEMS_IN_MAP];
+
+// Every entry in the slot array must be reachable through a lookup of its own key,
+// Robin Hood lookups stop early so a misordered cluster would show up here
+static int checkAllReachable(staticMap_t *map) {
+    for (size_t i = 0; i < map->length; i++) {
+        staticMapItem_t *slot = staticMapSlotItem(map, i);
+        if (staticMapItemState(slot) == STATIC_MAP_SLOT_IN_USE && staticMapFind(map, slot->key) != slot) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int testRobinHood(void) {
+    staticMapConfig_t config = {.probe = STATIC_MAP_PROBE_ROBIN_HOOD};
+    int32_t result = staticMapInitWithConfig(&rh_map, rh_array, RH_ITEMS_IN_MAP, sizeof(rh_item_map[0]), &rh_item_map[0].node, &config);
+    if (result != STATIC_MAP_SUCCESS) {
+        printf("Test failed: Robin Hood map init failed\n");
+        return 1;
+    }
+
+    // Fill to 87.5% with keys that collide in small groups
+    for (uint32_t i = 0; i < RH_NUM_KEYS; i++) {
+        uint32_t key = (i % 8) * RH_ITEMS_IN_MAP + i / 8 * 3;
+        if (insertDataItem(&rh_map, i, key) == NULL) {
+            printf("Test failed: Robin Hood insert of %u failed\n", key);
+            return 1;
+        }
+    }
+
+    if (insertDataItem(&rh_map, 0, 0) != NULL) {
+        printf("Test failed: Robin Hood accepted a duplicate key\n");
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < RH_NUM_KEYS; i++) {
+        uint32_t key = (i % 8) * RH_ITEMS_IN_MAP + i / 8 * 3;
+        myItem_t *item = findItem(&rh_map, key);
+        if (item == NULL || item->data != i) {
+            printf("Test failed: Robin Hood lookup of %u failed\n", key);
+            return 1;
+        }
+    }
+
+    if (findItem(&rh_map, 1) != NULL || findItem(&rh_map, 9 * RH_ITEMS_IN_MAP) != NULL) {
+        printf("Test failed: Robin Hood found a key that was never inserted\n");
+        return 1;
+    }
+
+    if (checkAllReachable(&rh_map) != 0) {
+        printf("Test failed: Robin Hood map is not reachable after insert\n");
+        return 1;
+    }
+
+    // Remove every other key and check that the rest survives the backward shifts
+    for (uint32_t i = 0; i < RH_NUM_KEYS; i += 2) {
+        uint32_t key = (i % 8) * RH_ITEMS_IN_MAP + i / 8 * 3;
+        if (removeItemByKey(&rh_map, key) != STATIC_MAP_SUCCESS) {
+            printf("Test failed: Robin Hood remove of %u failed\n", key);
+            return 1;
+        }
+    }
+
+    for (uint32_t i = 0; i < RH_NUM_KEYS; i++) {
+        uint32_t key = (i % 8) * RH_ITEMS_IN_MAP + i / 8 * 3;
+        myItem_t *item = findItem(&rh_map, key);
+        if ((i % 2 == 0) != (item == NULL)) {
+            printf("Test failed: Robin Hood lookup of %u after remove is wrong\n", key);
+            return 1;
+        }
+    }
+
+    if (checkAllReachable(&rh_map) != 0 || staticMapGetNumItems(&rh_map) != RH_NUM_KEYS / 2) {
+        printf("Test failed: Robin Hood map is broken after remove\n");
+        return 1;
+    }
+    printf("Test passed: Robin Hood insert, find and remove\n");
+
+    return 0;
+}
+
+#define HASH_ITEMS_IN_MAP 64
+
+staticMap_t hash_map = {0};
+staticMapItem_t * hash_array[HASH_ITEMS_IN_MAP];
+myItem_t hash_item_map[HASH_ITEMS_IN_MAP];
+
+static uint32_t hash_calls = 0;
+
+static uint32_t countingHash(uint32_t key, uint32_t seed) {
+    hash_calls++;
+    return staticMapHashIdentity(key, seed);
+}
+
+static int testHashConfig(void) {
+    // Keys that are multiples of 16 only hit 4 buckets of 64 with plain modulo
+    uint8_t used[HASH_ITEMS_IN_MAP] = {0};
+    uint32_t buckets = 0;
+    for (uint32_t i = 0; i < HASH_ITEMS_IN_MAP / 2; i++) {
+        uint32_t bucket = staticMapHashMix32(i * 16, 0) & (HASH_ITEMS_IN_MAP - 1);
+        buckets += used[bucket] ? 0 : 1;
+        used[bucket] = 1;
+    }
+
+    if (buckets < HASH_ITEMS_IN_MAP / 4) {
+        printf("Test failed: Default hash only used %u buckets for strided keys\n", buckets);
+        return 1;
+    }
+
+    // A caller supplied hash gets the configured seed, identity hashing places keys at key % length
+    staticMapConfig_t config = {.hash = countingHash, .seed = 3};
+    int32_t result = staticMapInitWithConfig(&hash_map, hash_array, HASH_ITEMS_IN_MAP, sizeof(hash_item_map[0]), &hash_item_map[0].node, &config);
+    if (result != STATIC_MAP_SUCCESS) {
+        printf("Test failed: Hash map init failed\n");
+        return 1;
+    }
+
+    for (uint32_t key = 0; key < HASH_ITEMS_IN_MAP; key += 5) {
+        if (insertDataItem(&hash_map, key, key) == NULL) {
+            printf("Test failed: Insert with custom hash failed\n");
+            return 1;
+        }
+
+        if (hash_map.items[(key ^ 3) & (HASH_ITEMS_IN_MAP - 1)]->key != key) {
+            printf("Test failed: Custom hash placed %u in the wrong slot\n", key);
+            return 1;
+        }
+    }
+
+    if (hash_calls == 0 || findItem(&hash_map, 10) == NULL || findItem(&hash_map, 11) != NULL) {
+        printf("Test failed: Lookup with custom hash failed\n");
+        return 1;
+    }
+    printf("Test passed: Configurable hashing\n");
+
+    return 0;
+}
+
+#define CTRL_ITEMS_IN_MAP 100
+#define CTRL_NUM_KEYS 90
+
+staticMap_t ctrl_map = {0};
+staticMapItem_t * ctrl_array[CTRL_ITEMS_IN_MAP];
+myItem_t ctrl_item_map[CTRL_ITEMS_IN_MAP];
+uint8_t ctrl_bytes[STATIC_MAP_CTRL_BYTES(CTRL_ITEMS_IN_MAP)];
+
+static int testControlBytes(void) {
+    staticMapConfig_t config = {.ctrl = ctrl_bytes};
+    int32_t result = staticMapInitWithConfig(&ctrl_map, ctrl_array, CTRL_ITEMS_IN_MAP, sizeof(ctrl_item_map[0]), &ctrl_item_map[0].node, &config);
+    if (result != STATIC_MAP_SUCCESS) {
+        printf("Test failed: Control byte map init failed\n");
+        return 1;
+    }
+
+    // 90% load on a length that is not a multiple of the group width, so groups wrap
+    for (uint32_t key = 0; key < CTRL_NUM_KEYS; key++) {
+        if (insertDataItem(&ctrl_map, key, key * 7) == NULL) {
+            printf("Test failed: Control byte insert of %u failed\n", key * 7);
+            return 1;
+        }
+    }
+
+    if (insertDataItem(&ctrl_map, 0, 7) != NULL) {
+        printf("Test failed: Control byte map accepted a duplicate key\n");
+        return 1;
+    }
+
+    for (uint32_t key = 0; key < CTRL_NUM_KEYS; key += 3) {
+        if (removeItemByKey(&ctrl_map, key * 7) != STATIC_MAP_SUCCESS) {
+            printf("Test failed: Control byte remove of %u failed\n", key * 7);
+            return 1;
+        }
+    }
+
+    for (uint32_t key = 0; key < CTRL_NUM_KEYS + 10; key++) {
+        myItem_t *item = findItem(&ctrl_map, key * 7);
+        bool present = key < CTRL_NUM_KEYS && key % 3 != 0;
+        if (present != (item != NULL) || (item != NULL && item->data != key)) {
+            printf("Test failed: Control byte lookup of %u is wrong\n", key * 7);
+            return 1;
+        }
+    }
+
+    // Control bytes must follow the slots, including the mirrored tail
+    for (size_t i = 0; i < STATIC_MAP_CTRL_BYTES(CTRL_ITEMS_IN_MAP); i++) {
+        bool in_use = staticMapItemState(ctrl_array[i % CTRL_ITEMS_IN_MAP]) == STATIC_MAP_SLOT_IN_USE;
+        if (in_use != ((ctrl_bytes[i] & 0x80) == 0)) {
+            printf("Test failed: Control byte %zu does not match its slot\n", i);
+            return 1;
+        }
+    }
+
+    if (checkAllReachable(&ctrl_map) != 0) {
+        printf("Test failed: Control byte map entry is unreachable\n");
+        return 1;
+    }
+    printf("Test passed: Control byte group probing\n");
+
+    return 0;
+}
+
+static int testStats(void) {
+    // Reuse the Robin Hood map, it is half full after its own test
+    staticMapStats_t stats;
+    int32_t result = staticMapGetStats(&rh_map, &stats);
+    if (result != STATIC_MAP_SUCCESS) {
+        printf("Test failed: Get stats failed\n");
+        return 1;
+    }
+
+    if (stats.in_use != RH_NUM_KEYS / 2 || stats.tombstones != 0 ||
+        stats.in_use + stats.empty != RH_ITEMS_IN_MAP ||
+        stats.in_use != (size_t)staticMapGetNumItems(&rh_map)) {
+        printf("Test failed: Stats slot counts are wrong\n");
+        return 1;
+    }
+
+    uint32_t histogram_total = 0;
+    for (uint32_t i = 0; i < STATIC_MAP_PROBE_HISTOGRAM_SIZE; i++) {
+        histogram_total += stats.probe_histogram[i];
+    }
+
+    if (histogram_total != stats.in_use || stats.avg_probe_distance > (float)stats.max_probe_distance ||
+        stats.load_factor != (float)stats.in_use / RH_ITEMS_IN_MAP) {
+        printf("Test failed: Stats probe distances are wrong\n");
+        return 1;
+    }
+
+#ifdef STATIC_MAP_STATS
+    staticMapResetStats(&rh_map);
+    findItem(&rh_map, 0);
+    findItem(&rh_map, 1);
+    staticMapGetStats(&rh_map, &stats);
+    if (stats.counters.lookups != 2 || stats.counters.lookup_misses < 1 || stats.counters.probes < 2) {
+        printf("Test failed: Stats counters are wrong\n");
+        return 1;
+    }
+#endif
+    printf("Test passed: Map statistics\n");
+
+    return 0;
+}
+
+#define BATCH_ITEMS_IN_MAP 64
+#define BATCH_NUM_KEYS 40
+
+staticMap_t batch_map = {0};
+staticMapItem_t * batch_array[BATCH_ITEMS_IN_MAP];
+myItem_t batch_item_map[BATCH_ITEMS_IN_MAP];
+
+// Batch lookups must give the same answer as one staticMapFind per key
+static int checkFindBatch(staticMap_t *map, const uint32_t *keys, size_t n) {
+    staticMapItem_t *out[BATCH_NUM_KEYS * 2];
+    int32_t found = staticMapFindBatch(map, keys, n, out);
+    int32_t expected = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        staticMapItem_t *item = staticMapFind(map, keys[i]);
+        if (out[i] != item) {
+            return 1;
+        }
+        expected += item != NULL ? 1 : 0;
+    }
+
+    return found == expected ? 0 : 1;
+}
+
+static int testBatch(void) {
+    staticMapConfig_t config = {.probe = STATIC_MAP_PROBE_ROBIN_HOOD};
+    int32_t result = staticMapInitWithConfig(&batch_map, batch_array, BATCH_ITEMS_IN_MAP, sizeof(batch_item_map[0]), &batch_item_map[0].node, &config);
+    if (result != STATIC_MAP_SUCCESS) {
+        printf("Test failed: Batch map init failed\n");
+        return 1;
+    }
+
+    // The second half of the keys repeats the first half, those inserts must fail
+    uint32_t keys[BATCH_NUM_KEYS * 2];
+    staticMapItem_t *out[BATCH_NUM_KEYS * 2];
+    for (uint32_t i = 0; i < BATCH_NUM_KEYS; i++) {
+        keys[i] = i * 37;
+        keys[BATCH_NUM_KEYS + i] = i * 37;
+    }
+
+    result = staticMapInsertBatch(&batch_map, keys, BATCH_NUM_KEYS * 2, out);
+    if (result != BATCH_NUM_KEYS || out[0] == NULL || out[BATCH_NUM_KEYS] != NULL) {
+        printf("Test failed: Batch insert returned %i\n", result);
+        return 1;
+    }
+
+    // Look up a mix of present and missing keys
+    for (uint32_t i = 0; i < BATCH_NUM_KEYS; i++) {
+        keys[BATCH_NUM_KEYS + i] = i * 37 + 1;
+    }
+
+    if (checkFindBatch(&batch_map, keys, BATCH_NUM_KEYS * 2) != 0 || checkFindBatch(&ctrl_map, keys, BATCH_NUM_KEYS * 2) != 0) {
+        printf("Test failed: Batch find differs from single finds\n");
+        return 1;
+    }
+
+    result = staticMapRemoveBatch(&batch_map, keys, BATCH_NUM_KEYS + 5);
+    if (result != BATCH_NUM_KEYS || staticMapGetNumItems(&batch_map) != 0) {
+        printf("Test failed: Batch remove returned %i\n", result);
+        return 1;
+    }
+    printf("Test passed: Batch insert, find and remove\n");
+
+    return 0;
+}
+
+#ifndef STATIC_MAP_UNORDERED
+#define LRU_ITEMS_IN_MAP 16
+#define LRU_CAPACITY 8
+
+staticMap_t lru_map = {0};
+staticMapItem_t * lru_array[LRU_ITEMS_IN_MAP];
+myItem_t lru_item_map[LRU_ITEMS_IN_MAP];
+
+static uint32_t evicted_keys[LRU_ITEMS_IN_MAP];
+static uint32_t num_evicted = 0;
+static uint32_t evict_errors = 0;
+
+static void lruEvictCb(staticMap_t *map, staticMapItem_t *map_item) {
+    // The item must still be in the map with its key
+    if (staticMapFind(map, map_item->key) != map_item) {
+        evict_errors++;
+    }
+    evicted_keys[num_evicted++ % LRU_ITEMS_IN_MAP] = map_item->key;
+}
+
+// Evict through a map of every length and probe scheme, the new key must take the evicted struct
+static int lruEvictAll(staticMap_t *map, uint32_t first_key, uint32_t num_keys, bool reuse) {
+    for (uint32_t key = first_key; key < first_key + num_keys; key++) {
+        staticMapItem_t *oldest = map->tail;
+        uint32_t oldest_key = oldest->key;
+        staticMapItem_t *item = staticMapInsertOrEvict(map, key);
+
+        if (item == NULL || item->key != key || map->head != item || (reuse && item != oldest) ||
+            staticMapFind(map, key) != item || staticMapFind(map, oldest_key) != NULL) {
+            return 1;
+        }
+    }
+
+    return evict_errors != 0 || checkAllReachable(map) != 0;
+}
+
+static int testLru(void) {
+    staticMapConfig_t config = {.capacity = LRU_CAPACITY, .evict = lruEvictCb};
+    int32_t result = staticMapInitWithConfig(&lru_map, lru_array, LRU_ITEMS_IN_MAP, sizeof(lru_item_map[0]), &lru_item_map[0].node, &config);
+    if (result != STATIC_MAP_SUCCESS) {
+        printf("Test failed: LRU map init failed\n");
+        return 1;
+    }
+
+    for (uint32_t key = 0; key < LRU_CAPACITY; key++) {
+        if (staticMapInsertOrEvict(&lru_map, key) == NULL) {
+            printf("Test failed: LRU insert of %u failed\n", key);
+            return 1;
+        }
+    }
+
+    // Touch the oldest key, the next insert must evict the second oldest instead
+    staticMapItem_t *touched = staticMapFindAndTouch(&lru_map, 0);
+    if (touched == NULL || lru_map.head != touched || lru_map.tail->key != 1) {
+        printf("Test failed: Touch did not move the item to head\n");
+        return 1;
+    }
+
+    if (staticMapInsertOrEvict(&lru_map, 100) == NULL || staticMapInsertOrEvict(&lru_map, 101) == NULL) {
+        printf("Test failed: LRU insert with eviction failed\n");
+        return 1;
+    }
+
+    if (num_evicted != 2 || evicted_keys[0] != 1 || evicted_keys[1] != 2 ||
+        staticMapFind(&lru_map, 1) != NULL || staticMapFind(&lru_map, 0) == NULL ||
+        staticMapGetNumItems(&lru_map) != LRU_CAPACITY) {
+        printf("Test failed: LRU evicted the wrong items\n");
+        return 1;
+    }
+
+    // A duplicate key must not evict anything
+    if (staticMapInsertOrEvict(&lru_map, 100) != NULL || num_evicted != 2) {
+        printf("Test failed: LRU duplicate insert evicted an item\n");
+        return 1;
+    }
+
+    if (countSlotsInState(&lru_map, STATIC_MAP_SLOT_DELETED) != 0 || checkAllReachable(&lru_map) != 0) {
+        printf("Test failed: LRU map is broken after eviction\n");
+        return 1;
+    }
+
+    if (lruEvictAll(&lru_map, 200, 3 * LRU_ITEMS_IN_MAP, true) != 0 || staticMapGetNumItems(&lru_map) != LRU_CAPACITY) {
+        printf("Test failed: LRU eviction did not reuse the evicted struct\n");
+        return 1;
+    }
+
+    // Completely full maps, the only free slot after the eviction is the evicted one
+    staticMapProbe_t probes[] = {STATIC_MAP_PROBE_LINEAR, STATIC_MAP_PROBE_ROBIN_HOOD};
+    for (uint32_t i = 0; i < sizeof(probes) / sizeof(probes[0]); i++) {
+        staticMapConfig_t full = {.probe = probes[i], .evict = lruEvictCb};
+        staticMapInitWithConfig(&lru_map, lru_array, LRU_ITEMS_IN_MAP, sizeof(lru_item_map[0]), &lru_item_map[0].node, &full);
+        for (uint32_t key = 0; key < LRU_ITEMS_IN_MAP; key++) {
+            staticMapInsertOrEvict(&lru_map, key * 3);
+        }
+
+        if (staticMapGetNumItems(&lru_map) != LRU_ITEMS_IN_MAP || staticMapInsertOrEvict(&lru_map, 3) != NULL ||
+            lruEvictAll(&lru_map, 500, 2 * LRU_ITEMS_IN_MAP, true) != 0 || staticMapGetNumItems(&lru_map) != LRU_ITEMS_IN_MAP) {
+            printf("Test failed: Eviction from a full map with probe %u\n", probes[i]);
+            return 1;
+        }
+    }
+
+    // Strided maps can not hand over structs, the new key still replaces the oldest
+    staticMapConfig_t strided = {.probe = STATIC_MAP_PROBE_ROBIN_HOOD, .capacity = LRU_CAPACITY, .evict = lruEvictCb};
+    STATIC_MAP_INIT_STRIDED(lru_map, LRU_ITEMS_IN_MAP, lru_item_map, node, &strided);
+    for (uint32_t key = 0; key < LRU_CAPACITY; key++) {
+        staticMapInsertOrEvict(&lru_map, key);
+    }
+    if (lruEvictAll(&lru_map, 700, 3 * LRU_ITEMS_IN_MAP, false) != 0 ||
+        staticMapGetNumItems(&lru_map) != LRU_CAPACITY) {
+        printf("Test failed: Eviction from a strided map\n");
+        return 1;
+    }
+    printf("Test passed: LRU touch and eviction\n");
+
+    return 0;
+}
+
+#ifdef STATIC_MAP_TTL
+#define TTL_TICKS 100
+#define EXPIRE_KEYS 12
+
+static uint32_t expireHash(uint32_t key, uint32_t seed) {
+    (void)seed;
+    return key & 1;
+}
+
+// Keys 0 to 2 and 8 never expire
+static bool expireKeyless(uint32_t key) {
+    return key < 3 || key == 8;
+}
+
+// The list must be the original order without the keys below limit that have a deadline
+static int expireOrderKept(staticMap_t *map, const uint32_t *order, uint32_t listed, uint32_t limit) {
+    uint32_t position = 0;
+    staticMapIter_t iter;
+    STATIC_MAP_FOREACH(map, iter, item) {
+        while (position < listed && !expireKeyless(order[position]) && order[position] < limit) {
+            position++;
+        }
+        if (position >= listed || order[position++] != item->key) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int testExpire(void) {
+    // Reuse the LRU map, empty it first
+    staticMapConfig_t config = {.evict = lruEvictCb};
+    staticMapInitWithConfig(&lru_map, lru_array, LRU_ITEMS_IN_MAP, sizeof(lru_item_map[0]), &lru_item_map[0].node, &config);
+    num_evicted = 0;
+
+    // Start close to the wrap of the clock
+    uint32_t now = UINT32_MAX - 5;
+    for (uint32_t key = 0; key < 10; key++) {
+        staticMapItem_t *item = staticMapInsertAndGet(&lru_map, key);
+        if (item == NULL || staticMapSetDeadline(&lru_map, item, now + TTL_TICKS) != STATIC_MAP_SUCCESS) {
+            printf("Test failed: Set deadline failed\n");
+            return 1;
+        }
+        now += 2;
+    }
+
+    // Refresh key 0, it is now the last to expire
+    uint32_t refreshed_deadline = now + TTL_TICKS;
+    staticMapSetDeadline(&lru_map, staticMapFind(&lru_map, 0), refreshed_deadline);
+
+    // Nothing has expired yet
+    uint32_t next_deadline = 0;
+    int32_t result = staticMapExpire(&lru_map, now, 100, &next_deadline);
+    if (result != 0 || next_deadline != UINT32_MAX - 5 + 2 + TTL_TICKS) {
+        printf("Test failed: Expire removed items too early\n");
+        return 1;
+    }
+
+    // Keys 1 to 9 have expired, but only 4 may be removed per call
+    now = refreshed_deadline - 1;
+    result = staticMapExpire(&lru_map, now, 4, &next_deadline);
+    if (result != 4 || num_evicted != 4 || evicted_keys[0] != 1 || staticMapGetNumItems(&lru_map) != 6) {
+        printf("Test failed: Expire did not respect the budget, removed %i\n", result);
+        return 1;
+    }
+
+    result = staticMapExpire(&lru_map, now, 100, &next_deadline);
+    if (result != 5 || staticMapGetNumItems(&lru_map) != 1 || staticMapFind(&lru_map, 0) == NULL ||
+        next_deadline != refreshed_deadline) {
+        printf("Test failed: Expire removed the wrong items\n");
+        return 1;
+    }
+
+    // Reinserted keys reuse structs that held a deadline, they must start without one
+    for (uint32_t key = 1; key < 10; key++) {
+        staticMapItem_t *item = staticMapInsertAndGet(&lru_map, key);
+        if (item == NULL || item->deadline != STATIC_MAP_NO_DEADLINE) {
+            printf("Test failed: Key %u kept an old deadline\n", key);
+            return 1;
+        }
+    }
+
+    // Only key 0 has a deadline, the others never expire
+    now = refreshed_deadline + 20;
+    result = staticMapExpire(&lru_map, now, 100, &next_deadline);
+    if (result != 1 || staticMapGetNumItems(&lru_map) != 9 || staticMapFind(&lru_map, 0) != NULL ||
+        staticMapExpire(&lru_map, now + 1000, 100, NULL) != 0 || staticMapGetNumItems(&lru_map) != 9) {
+        printf("Test failed: Expire removed items without a deadline, removed %i\n", result);
+        return 1;
+    }
+
+    // Items without a deadline in front of expired ones are stepped over in place, also when a
+    // strided map shifts the items behind a removed one. Every key shares one of two buckets
+    for (int strided = 0; strided < 2; strided++) {
+        staticMapConfig_t clustered = {.probe = STATIC_MAP_PROBE_ROBIN_HOOD, .hash = expireHash, .evict = lruEvictCb};
+        if (strided) {
+            STATIC_MAP_INIT_STRIDED(lru_map, LRU_ITEMS_IN_MAP, lru_item_map, node, &clustered);
+        } else {
+            staticMapInitWithConfig(&lru_map, lru_array, LRU_ITEMS_IN_MAP, sizeof(lru_item_map[0]), &lru_item_map[0].node, &clustered);
+        }
+        num_evicted = 0;
+
+        now = 1000;
+        for (uint32_t key = 0; key < EXPIRE_KEYS; key++) {
+            staticMapItem_t *item = staticMapInsertAndGet(&lru_map, key);
+            if (!expireKeyless(key)) {
+                staticMapSetDeadline(&lru_map, item, now + key);
+            }
+        }
+
+        uint32_t order[EXPIRE_KEYS];
+        uint32_t listed = 0;
+        staticMapIter_t iter;
+        STATIC_MAP_FOREACH(&lru_map, iter, item) {
+            order[listed++] = item->key;
+        }
+
+        // Only expirations count against the budget
+        next_deadline = 0;
+        now += 2 * EXPIRE_KEYS;
+        result = staticMapExpire(&lru_map, now, 3, &next_deadline);
+        if (result != 3 || num_evicted != 3 || evicted_keys[0] != 3 || evicted_keys[2] != 5 ||
+            next_deadline != 1000 + 6 || expireOrderKept(&lru_map, order, listed, 6) != 0) {
+            printf("Test failed: Expire stepped over keys without a deadline wrongly, removed %i\n", result);
+            return 1;
+        }
+
+        next_deadline = 0;
+        result = staticMapExpire(&lru_map, now, 100, &next_deadline);
+        if (result != 5 || next_deadline != 0 || staticMapGetNumItems(&lru_map) != 4 || evict_errors != 0 ||
+            checkAllReachable(&lru_map) != 0 || expireOrderKept(&lru_map, order, listed, EXPIRE_KEYS) != 0) {
+            printf("Test failed: Expire left %i items\n", staticMapGetNumItems(&lru_map));
+            return 1;
+        }
+    }
+    printf("Test passed: Incremental expiry\n");
+
+    return 0;
+}
+#endif
+#endif
+
+#define CONC_ITEMS_IN_MAP 64
+#define CONC_STABLE_KEYS 16
+#define CONC_READS 200000
+#define CONC_NUM_READERS 2
+
+staticMap_t conc_map = {0};
+staticMapItem_t * conc_array[CONC_ITEMS_IN_MAP];
+myItem_t conc_item_map[CONC_ITEMS_IN_MAP];
+
+static uint32_t conc_readers_done = 0;
+
+// Payload of a stable key, it is rewritten every time the key is moved to a new item
+static uint32_t concPayload(uint32_t key) {
+    return key * 7 + 1;
+}
+
+static void *concReader(void *arg) {
+    uint32_t *errors = arg;
+    uint32_t key = 0;
+
+    for (uint32_t read = 0; read < CONC_READS; read++) {
+        staticMapItem_t *item;
+        uint32_t found_key = 0;
+        uint32_t data = 0;
+        uint32_t seq;
+
+        do {
+            seq  = staticMapReadBegin(&conc_map);
+            item = staticMapFindConcurrent(&conc_map, key);
+            if (item != NULL) {
+                found_key = __atomic_load_n(&item->key, __ATOMIC_RELAXED);
+                myItem_t *my_item = CONTAINER_OF(item, myItem_t, node);
+                data = __atomic_load_n(&my_item->data, __ATOMIC_RELAXED);
+            }
+        } while (staticMapReadRetry(&conc_map, seq));
+
+        // Stable keys are replaced inside one write section, so they are always found
+        if (item == NULL || found_key != key || data != concPayload(key)) {
+            (*errors)++;
+        }
+
+        key = (key + 1) % CONC_STABLE_KEYS;
+    }
+
+    __atomic_add_fetch(&conc_readers_done, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+static int testConcurrentReaders(void) {
+    staticMapConfig_t config = {.probe = STATIC_MAP_PROBE_ROBIN_HOOD, .concurrent = true};
+    staticMapInitWithConfig(&conc_map, conc_array, CONC_ITEMS_IN_MAP, sizeof(conc_item_map[0]), &conc_item_map[0].node, &config);
+
+    for (uint32_t key = 0; key < CONC_STABLE_KEYS; key++) {
+        myItem_t *my_item = CONTAINER_OF(staticMapInsertAndGet(&conc_map, key), myItem_t, node);
+        my_item->data = concPayload(key);
+    }
+
+    pthread_t readers[CONC_NUM_READERS];
+    uint32_t errors[CONC_NUM_READERS] = {0};
+    for (int i = 0; i < CONC_NUM_READERS; i++) {
+        pthread_create(&readers[i], NULL, concReader, &errors[i]);
+    }
+
+    // The writer churns other keys, which shifts the stable ones around, and now and then
+    // moves a stable key to a new item, reusing the storage of the old one for another key
+    for (uint32_t round = 0; __atomic_load_n(&conc_readers_done, __ATOMIC_RELAXED) < CONC_NUM_READERS; round++) {
+        uint32_t churn_key = 1000 + round % 40;
+        if (staticMapFind(&conc_map, churn_key) != NULL) {
+            staticMapRemoveByKey(&conc_map, churn_key);
+        } else {
+            staticMapInsertAndGet(&conc_map, churn_key);
+        }
+
+        if (round % 16 == 0) {
+            uint32_t key = round % CONC_STABLE_KEYS;
+            staticMapWriteBegin(&conc_map);
+            staticMapRemoveByKey(&conc_map, key);
+            myItem_t *my_item = CONTAINER_OF(staticMapInsertAndGet(&conc_map, key), myItem_t, node);
+            __atomic_store_n(&my_item->data, concPayload(key), __ATOMIC_RELAXED);
+            staticMapWriteEnd(&conc_map);
+        }
+    }
+
+    uint32_t total_errors = 0;
+    for (int i = 0; i < CONC_NUM_READERS; i++) {
+        pthread_join(readers[i], NULL);
+        total_errors += errors[i];
+    }
+
+    if (total_errors != 0 || (conc_map.seq & 1) != 0) {
+        printf("Test failed: Concurrent readers saw %u inconsistent results\n", total_errors);
+        return 1;
+    }
+    printf("Test passed: Concurrent readers\n");
+
+    return 0;
+}
+
+#define TYPED_CAPACITY 64
+#define TYPED_KEYS 56
+
+typedef struct {
+    uint64_t id;
+    uint32_t data;
+} u64Item_t;
+
+STATIC_MAP_DEFINE(u64Map, u64Item_t, id, uint64_t, staticMapHashU64, staticMapEqU64, TYPED_CAPACITY)
+
+// A packed 5-tuple, src ip, dst ip, src port, dst port and protocol
+STATIC_MAP_BYTES_KEY(flowKey, 13)
+
+typedef struct {
+    flowKey_t key;
+    uint32_t  packets;
+} flow_t;
+
+STATIC_MAP_DEFINE(flowMap, flow_t, key, flowKey_t, flowKey_hash, flowKey_eq, 16)
+
+static u64Map_t u64_map;
+static flowMap_t flow_map;
+
+static flowKey_t makeFlowKey(uint32_t src, uint32_t dst, uint16_t sport, uint16_t dport, uint8_t proto) {
+    flowKey_t key;
+    memcpy(&key.bytes[0], &src, 4);
+    memcpy(&key.bytes[4], &dst, 4);
+    memcpy(&key.bytes[8], &sport, 2);
+    memcpy(&key.bytes[10], &dport, 2);
+    key.bytes[12] = proto;
+    return key;
+}
+
+static int testTypedMap(void) {
+    u64Map_init(&u64_map);
+
+    // Keys that only differ in the upper 32 bits must not collide
+    for (uint64_t i = 0; i < TYPED_KEYS; i++) {
+        u64Item_t *item = u64Map_insert(&u64_map, i << 32);
+        if (item == NULL) {
+            printf("Test failed: Typed insert failed\n");
+            return 1;
+        }
+        item->data = (uint32_t)i;
+    }
+
+    if (u64Map_insert(&u64_map, 5ULL << 32) != NULL || u64Map_count(&u64_map) != TYPED_KEYS) {
+        printf("Test failed: Typed map accepted a duplicate key\n");
+        return 1;
+    }
+
+    for (uint64_t i = 0; i < TYPED_KEYS; i += 2) {
+        if (u64Map_remove(&u64_map, i << 32) != STATIC_MAP_SUCCESS) {
+            printf("Test failed: Typed remove failed\n");
+            return 1;
+        }
+    }
+
+    for (uint64_t i = 0; i < TYPED_KEYS; i++) {
+        u64Item_t *item = u64Map_find(&u64_map, i << 32);
+        bool should_exist = (i % 2) == 1;
+        if ((item != NULL) != should_exist || (item != NULL && item->data != i)) {
+            printf("Test failed: Typed find of key %u\n", (uint32_t)i);
+            return 1;
+        }
+    }
+
+    if (u64Map_remove_item(&u64_map, u64Map_find(&u64_map, 1ULL << 32)) != STATIC_MAP_SUCCESS ||
+        u64Map_remove(&u64_map, 1ULL << 32) != STATIC_MAP_UNUSED_ERASE) {
+        printf("Test failed: Typed remove by item\n");
+        return 1;
+    }
+
+    flowMap_init(&flow_map);
+    flowKey_t tcp = makeFlowKey(0x0a000001, 0x0a000002, 1234, 80, 6);
+    flowKey_t udp = makeFlowKey(0x0a000001, 0x0a000002, 1234, 80, 17);
+    flowMap_insert(&flow_map, tcp)->packets = 10;
+    flowMap_insert(&flow_map, udp)->packets = 20;
+
+    flow_t *flow = flowMap_find(&flow_map, makeFlowKey(0x0a000001, 0x0a000002, 1234, 80, 6));
+    if (flow == NULL || flow->packets != 10 || flowMap_find(&flow_map, udp)->packets != 20 ||
+        flowMap_find(&flow_map, makeFlowKey(0x0a000001, 0x0a000002, 1234, 81, 6)) != NULL) {
+        printf("Test failed: Byte key lookup\n");
+        return 1;
+    }
+    printf("Test passed: Typed maps\n");
+
+    return 0;
+}
+
+static int testIterator(void) {
+    // Reuse the batch map, 0 to 39 inserted in order
+    staticMapConfig_t config = {0};
+    staticMapInitWithConfig(&batch_map, batch_array, BATCH_ITEMS_IN_MAP, sizeof(batch_item_map[0]), &batch_item_map[0].node, &config);
+    for (uint32_t key = 0; key < 40; key++) {
+        staticMapInsertAndGet(&batch_map, key);
+    }
+
+    // Erase every even key while iterating, every key must still be visited once
+    uint64_t seen = 0;
+    uint32_t expected = 0;
+    staticMapIter_t iter;
+    STATIC_MAP_FOREACH(&batch_map, iter, item) {
+#ifndef STATIC_MAP_UNORDERED
+        // Oldest first
+        if (item->key != expected) {
+            printf("Test failed: Iterator out of order\n");
+            return 1;
+        }
+#endif
+        expected++;
+        if (item->key >= 40 || (seen & (1ULL << item->key)) != 0) {
+            printf("Test failed: Iterator visited key %u twice\n", item->key);
+            return 1;
+        }
+        seen |= 1ULL << item->key;
+
+        if (item->key % 2 == 0 && staticMapIterErase(&iter) != STATIC_MAP_SUCCESS) {
+            printf("Test failed: Iterator erase failed\n");
+            return 1;
+        }
+    }
+
+    if (expected != 40 || staticMapGetNumItems(&batch_map) != 20 || checkAllReachable(&batch_map) != 0 ||
+        countSlotsInState(&batch_map, STATIC_MAP_SLOT_DELETED) != 0) {
+        printf("Test failed: Iterator erase left the map broken\n");
+        return 1;
+    }
+
+    uint32_t visited = 0;
+    STATIC_MAP_FOREACH(&batch_map, iter, item) {
+        if (item->key % 2 == 0) {
+            printf("Test failed: Erased item is still in the map\n");
+            return 1;
+        }
+        if (++visited == 5) {
+            break;
+        }
+    }
+
+    if (visited != 5) {
+        printf("Test failed: Iterator break\n");
+        return 1;
+    }
+
+    // A completely full Robin Hood map, clusters wrap around the end of the slot array
+    config.probe = STATIC_MAP_PROBE_ROBIN_HOOD;
+    staticMapInitWithConfig(&batch_map, batch_array, BATCH_ITEMS_IN_MAP, sizeof(batch_item_map[0]), &batch_item_map[0].node, &config);
+    for (uint32_t key = 0; key < BATCH_ITEMS_IN_MAP; key++) {
+        staticMapInsertAndGet(&batch_map, key * 7);
+    }
+
+    visited = 0;
+    STATIC_MAP_FOREACH(&batch_map, iter, item) {
+        visited++;
+        if (item->key % 3 == 0) {
+            staticMapIterErase(&iter);
+        }
+    }
+
+    if (visited != BATCH_ITEMS_IN_MAP || staticMapGetNumItems(&batch_map) != BATCH_ITEMS_IN_MAP - 22 ||
+        checkAllReachable(&batch_map) != 0 || countSlotsInState(&batch_map, STATIC_MAP_SLOT_DELETED) != 0) {
+        printf("Test failed: Iterator erase in a full map\n");
+        return 1;
+    }
+    printf("Test passed: Iterator\n");
+
+    return 0;
+}
+
+#if defined(STATIC_MAP_COMPACT_NODE) && !defined(STATIC_MAP_UNORDERED) && !defined(STATIC_MAP_TTL) && !defined(STATIC_MAP_STORED_HASH)
+static int testCompactNode(void) {
+    size_t expected_size = sizeof(staticMapLink_t) == 2 ? 8 : 12;
+    if (sizeof(staticMapItem_t) != expected_size) {
+        printf("Test failed: Compact node is %u bytes\n", (unsigned)sizeof(staticMapItem_t));
+        return 1;
+    }
+
+    // Lengths that do not fit a link are rejected before the storage is touched
+    int32_t result = staticMapInit(&batch_map, batch_array, (size_t)STATIC_MAP_MAX_ITEMS + 1, sizeof(batch_item_map[0]), &batch_item_map[0].node);
+    if (result != STATIC_MAP_INVALID_CONFIG) {
+        printf("Test failed: Compact node accepted a map that is too long\n");
+        return 1;
+    }
+    printf("Test passed: Compact node\n");
+
+    return 0;
+}
+#endif
+
+#define STRIDED_ITEMS_IN_MAP 64
+#define STRIDED_KEYS 56
+
+staticMap_t strided_map = {0};
+myItem_t strided_item_map[STRIDED_ITEMS_IN_MAP];
+uint8_t strided_ctrl[STATIC_MAP_CTRL_BYTES(STRIDED_ITEMS_IN_MAP)];
+
+// Every item in use must hold its own payload and be found by its key
+static int checkStridedPayload(staticMap_t *map) {
+    for (uint32_t i = 0; i < map->length; i++) {
+        staticMapItem_t *slot = staticMapSlotItem(map, i);
+        myItem_t *item = CONTAINER_OF(slot, myItem_t, node);
+        if (staticMapItemState(slot) == STATIC_MAP_SLOT_IN_USE &&
+            (item->data != slot->key * 3 || staticMapFind(map, slot->key) != slot)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int testStrided(void) {
+    for (int variant = 0; variant < 4; variant++) {
+        staticMapConfig_t config = {0};
+        config.probe = (variant & 1) ? STATIC_MAP_PROBE_ROBIN_HOOD : STATIC_MAP_PROBE_LINEAR;
+        config.ctrl  = (variant & 2) ? strided_ctrl : NULL;
+
+        int32_t result = STATIC_MAP_INIT_STRIDED(strided_map, STRIDED_ITEMS_IN_MAP, strided_item_map, node, &config);
+        if (result != STATIC_MAP_SUCCESS || strided_map.items != NULL) {
+            printf("Test failed: Strided init failed\n");
+            return 1;
+        }
+
+        for (uint32_t key = 0; key < STRIDED_KEYS; key++) {
+            if (insertDataItem(&strided_map, key * 5 * 3, key * 5) == NULL) {
+                printf("Test failed: Strided insert of %u failed\n", key);
+                return 1;
+            }
+        }
+
+        // Removes shift items back by copying them
+        for (uint32_t key = 0; key < STRIDED_KEYS; key += 3) {
+            if (staticMapRemoveByKey(&strided_map, key * 5) != STATIC_MAP_SUCCESS) {
+                printf("Test failed: Strided remove of %u failed\n", key);
+                return 1;
+            }
+        }
+
+        if (checkStridedPayload(&strided_map) != 0 || countSlotsInState(&strided_map, STATIC_MAP_SLOT_DELETED) != 0) {
+            printf("Test failed: Strided items lost their payload\n");
+            return 1;
+        }
+
+        // Erase while iterating, the items after the erased one may move
+        uint32_t visited = 0;
+        staticMapIter_t iter;
+        STATIC_MAP_FOREACH(&strided_map, iter, item) {
+            visited++;
+            if (item->key % 2 == 0) {
+                staticMapIterErase(&iter);
+            }
+        }
+
+        uint32_t remaining = STRIDED_KEYS - (STRIDED_KEYS + 2) / 3;
+        if (visited != remaining || checkStridedPayload(&strided_map) != 0) {
+            printf("Test failed: Strided iteration visited %u of %u items\n", visited, remaining);
+            return 1;
+        }
+
+#ifndef STATIC_MAP_UNORDERED
+        // The list must still hold every item once, oldest first
+        uint32_t listed = 0;
+        uint32_t previous_key = 0;
+        STATIC_MAP_FOREACH(&strided_map, iter, item) {
+            if (listed > 0 && item->key <= previous_key) {
+                printf("Test failed: Strided list out of order\n");
+                return 1;
+            }
+            previous_key = item->key;
+            listed++;
+        }
+
+        if (listed != (uint32_t)staticMapGetNumItems(&strided_map)) {
+            printf("Test failed: Strided list has %u items\n", listed);
+            return 1;
+        }
+#endif
+    }
+    printf("Test passed: Strided map\n");
+
+    return 0;
+}
+
+#define SNAPSHOT_ITEMS_IN_MAP 64
+#define SNAPSHOT_KEYS 50
+
+staticMap_t snapshot_map = {0};
+staticMap_t loaded_map = {0};
+staticMapItem_t * snapshot_array[SNAPSHOT_ITEMS_IN_MAP];
+myItem_t snapshot_item_map[SNAPSHOT_ITEMS_IN_MAP];
+uint8_t snapshot_ctrl[STATIC_MAP_CTRL_BYTES(SNAPSHOT_ITEMS_IN_MAP)];
+static uint64_t snapshot_buffer[1024];
+
+static int testSnapshot(void) {
+    staticMapConfig_t config = {.probe = STATIC_MAP_PROBE_ROBIN_HOOD, .ctrl = snapshot_ctrl, .seed = 11,
+                                .node_offset = offsetof(myItem_t, node)};
+    staticMapInitWithConfig(&snapshot_map, snapshot_array, SNAPSHOT_ITEMS_IN_MAP, sizeof(snapshot_item_map[0]), &snapshot_item_map[0].node, &config);
+
+    for (uint32_t key = 0; key < SNAPSHOT_KEYS; key++) {
+        insertDataItem(&snapshot_map, key + 1000, key * 13);
+    }
+    for (uint32_t key = 0; key < SNAPSHOT_KEYS; key += 4) {
+        staticMapRemoveByKey(&snapshot_map, key * 13);
+    }
+
+    size_t size = staticMapSnapshotSize(&snapshot_map);
+    if (size > sizeof(snapshot_buffer) || staticMapSnapshot(&snapshot_map, snapshot_buffer, size) != STATIC_MAP_SUCCESS ||
+        staticMapSnapshot(&snapshot_map, snapshot_buffer, size - 1) != STATIC_MAP_FULL) {
+        printf("Test failed: Snapshot failed\n");
+        return 1;
+    }
+
+    // Warm start from a file, the way a restarted process would
+    FILE *file = tmpfile();
+    if (file == NULL || fwrite(snapshot_buffer, 1, size, file) != size || fflush(file) != 0) {
+        printf("Test failed: Could not write the snapshot file\n");
+        return 1;
+    }
+
+    void *image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(file), 0);
+    if (image == MAP_FAILED) {
+        printf("Test failed: Could not map the snapshot file\n");
+        return 1;
+    }
+
+    if (staticMapLoad(&loaded_map, image, size, NULL) != STATIC_MAP_SUCCESS ||
+        staticMapGetNumItems(&loaded_map) != staticMapGetNumItems(&snapshot_map)) {
+        printf("Test failed: Load failed\n");
+        return 1;
+    }
+
+    for (uint32_t key = 0; key < SNAPSHOT_KEYS; key++) {
+        myItem_t *item = findItem(&loaded_map, key * 13);
+        bool should_exist = (key % 4) != 0;
+        if ((item != NULL) != should_exist || (item != NULL && item->data != key + 1000)) {
+            printf("Test failed: Loaded map lookup of %u\n", key * 13);
+            return 1;
+        }
+    }
+
+#ifndef STATIC_MAP_UNORDERED
+    // Same order as the original
+    staticMapIter_t iter;
+    staticMapItem_t *original = staticMapIterFirst(&snapshot_map, &iter);
+    staticMapIter_t loaded_iter;
+    STATIC_MAP_FOREACH(&loaded_map, loaded_iter, item) {
+        if (original == NULL || original->key != item->key) {
+            printf("Test failed: Loaded map list order differs\n");
+            return 1;
+        }
+        original = staticMapIterNext(&iter);
+    }
+#endif
+
+    // The loaded map is a normal map
+    if (staticMapRemoveByKey(&loaded_map, 13) != STATIC_MAP_SUCCESS || insertDataItem(&loaded_map, 7, 4242) == NULL ||
+        checkAllReachable(&loaded_map) != 0 || staticMapGetNumItems(&loaded_map) != staticMapGetNumItems(&snapshot_map)) {
+        printf("Test failed: Loaded map can not be modified\n");
+        return 1;
+    }
+
+    // A damaged image is refused
+    ((uint32_t *)image)[0] ^= 1;
+    if (staticMapLoad(&loaded_map, image, size, NULL) != STATIC_MAP_INVALID_IMAGE ||
+        staticMapLoad(&loaded_map, snapshot_buffer, size - 1, NULL) != STATIC_MAP_INVALID_IMAGE) {
+        printf("Test failed: Load accepted a bad image\n");
+        return 1;
+    }
+
+    munmap(image, size);
+    fclose(file);
+    printf("Test passed: Snapshot and load\n");
+
+    return 0;
+}
+
+#define SNAPSHOT_PAYLOAD_ITEMS 8
+
+typedef struct {
+    uint32_t before[3];
+    staticMapItem_t node;
+    uint32_t after;
+} payloadItem_t;
+
+staticMap_t payload_map = {0};
+staticMap_t payload_loaded = {0};
+staticMapItem_t * payload_array[SNAPSHOT_PAYLOAD_ITEMS];
+payloadItem_t payload_items[SNAPSHOT_PAYLOAD_ITEMS];
+static uint64_t payload_buffer[256];
+
+// Data on both sides of the node must survive a snapshot of a map set up with STATIC_MAP_INIT
+static int testSnapshotPayload(void) {
+    if (STATIC_MAP_INIT(payload_map, payload_array, SNAPSHOT_PAYLOAD_ITEMS, payload_items) != STATIC_MAP_SUCCESS) {
+        printf("Test failed: Payload map init\n");
+        return 1;
+    }
+
+    for (uint32_t key = 0; key < SNAPSHOT_PAYLOAD_ITEMS; key++) {
+        staticMapItem_t *node = staticMapInsertAndGet(&payload_map, key);
+        payloadItem_t *item = CONTAINER_OF(node, payloadItem_t, node);
+        item->before[0] = key + 100;
+        item->before[2] = key + 200;
+        item->after     = key + 300;
+    }
+
+    size_t size = staticMapSnapshotSize(&payload_map);
+    if (size > sizeof(payload_buffer) || staticMapSnapshot(&payload_map, payload_buffer, size) != STATIC_MAP_SUCCESS ||
+        staticMapLoad(&payload_loaded, payload_buffer, size, NULL) != STATIC_MAP_SUCCESS) {
+        printf("Test failed: Payload snapshot\n");
+        return 1;
+    }
+
+    for (uint32_t key = 0; key < SNAPSHOT_PAYLOAD_ITEMS; key++) {
+        staticMapItem_t *node = staticMapFind(&payload_loaded, key);
+        payloadItem_t *item = CONTAINER_OF(node, payloadItem_t, node);
+        if (node == NULL || item->before[0] != key + 100 || item->before[2] != key + 200 || item->after != key + 300) {
+            printf("Test failed: Payload of %u lost in the snapshot\n", key);
+            return 1;
+        }
+    }
+
+    printf("Test passed: Snapshot with data before the node\n");
+
+    return 0;
+}
+
+staticMap_t reloaded_map = {0};
+
+// A file mapped MAP_SHARED is changed through the loaded map, snapshotted in place and loaded again
+static int testSnapshotReload(void) {
+    staticMapConfig_t config = {.probe = STATIC_MAP_PROBE_ROBIN_HOOD, .ctrl = snapshot_ctrl,
+                                .node_offset = offsetof(myItem_t, node)};
+    staticMapInitWithConfig(&snapshot_map, snapshot_array, SNAPSHOT_ITEMS_IN_MAP, sizeof(snapshot_item_map[0]), &snapshot_item_map[0].node, &config);
+
+    for (uint32_t key = 0; key < SNAPSHOT_KEYS; key++) {
+        insertDataItem(&snapshot_map, key + 1000, key * 13);
+    }
+
+    size_t size = staticMapSnapshotSize(&snapshot_map);
+    FILE *file = tmpfile();
+    if (size > sizeof(snapshot_buffer) || staticMapSnapshot(&snapshot_map, snapshot_buffer, size) != STATIC_MAP_SUCCESS ||
+        file == NULL || fwrite(snapshot_buffer, 1, size, file) != size || fflush(file) != 0) {
+        printf("Test failed: Could not write the reload snapshot\n");
+        return 1;
+    }
+
+    void *image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(file), 0);
+    if (image == MAP_FAILED || staticMapLoad(&loaded_map, image, size, NULL) != STATIC_MAP_SUCCESS) {
+        printf("Test failed: Could not load the shared snapshot\n");
+        return 1;
+    }
+
+    // Remove the oldest quarter, add new keys and touch one so the list order changes
+    for (uint32_t key = 0; key < SNAPSHOT_KEYS / 4; key++) {
+        staticMapRemoveByKey(&loaded_map, key * 13);
+    }
+    for (uint32_t key = 0; key < 8; key++) {
+        insertDataItem(&loaded_map, key + 5000, key * 13 + 1);
+    }
+    findItem(&loaded_map, (SNAPSHOT_KEYS - 1) * 13)->data = 4242;
+    staticMapInsertAndGet(&loaded_map, 20 * 13);
+
+    uint32_t order[SNAPSHOT_ITEMS_IN_MAP];
+    uint32_t listed = 0;
+    staticMapIter_t iter;
+    STATIC_MAP_FOREACH(&loaded_map, iter, item) {
+        order[listed++] = item->key;
+    }
+    int32_t count = staticMapGetNumItems(&loaded_map);
+
+    if (staticMapSnapshot(&loaded_map, image, size) != STATIC_MAP_SUCCESS) {
+        printf("Test failed: Snapshot in place failed\n");
+        return 1;
+    }
+
+    // A second view at another address, like the next run of the process would have
+    void *reopened = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(file), 0);
+    if (reopened == MAP_FAILED || staticMapLoad(&reloaded_map, reopened, size, NULL) != STATIC_MAP_SUCCESS ||
+        staticMapGetNumItems(&reloaded_map) != count || checkAllReachable(&reloaded_map) != 0) {
+        printf("Test failed: Reload of the changed image failed\n");
+        return 1;
+    }
+
+    for (uint32_t key = 0; key < SNAPSHOT_KEYS; key++) {
+        myItem_t *item = findItem(&reloaded_map, key * 13);
+        uint32_t data = key == SNAPSHOT_KEYS - 1 ? 4242 : key + 1000;
+        if ((item != NULL) != (key >= SNAPSHOT_KEYS / 4) || (item != NULL && item->data != data)) {
+            printf("Test failed: Reloaded lookup of %u\n", key * 13);
+            return 1;
+        }
+    }
+    for (uint32_t key = 0; key < 8; key++) {
+        myItem_t *item = findItem(&reloaded_map, key * 13 + 1);
+        if (item == NULL || item->data != key + 5000) {
+            printf("Test failed: Reloaded lookup of new key %u\n", key * 13 + 1);
+            return 1;
+        }
+    }
+
+    uint32_t position = 0;
+    STATIC_MAP_FOREACH(&reloaded_map, iter, item) {
+        if (position >= listed || order[position++] != item->key) {
+            printf("Test failed: Reloaded list order differs\n");
+            return 1;
+        }
+    }
+
+    munmap(reopened, size);
+    munmap(image, size);
+    fclose(file);
+    printf("Test passed: Snapshot in place and reload\n");
+
+    return 0;
+}
+
+#define SHARED_ITEMS_IN_MAP 64
+#define SHARED_KEYS 40
+
+staticMap_t shared_writer = {0};
+staticMap_t shared_reader = {0};
+
+static int testSharedMap(void) {
+    size_t size = staticMapSharedSize(SHARED_ITEMS_IN_MAP, sizeof(myItem_t), true);
+    FILE *file = tmpfile();
+    if (file == NULL || ftruncate(fileno(file), (off_t)size) != 0) {
+        printf("Test failed: Could not create the shared file\n");
+        return 1;
+    }
+
+    // Two views of the same memory at different addresses, like two processes would have
+    void *writer_view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(file), 0);
+    void *reader_view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(file), 0);
+    if (writer_view == MAP_FAILED || reader_view == MAP_FAILED) {
+        printf("Test failed: Could not map the shared file\n");
+        return 1;
+    }
+
+    staticMapConfig_t config = {.probe = STATIC_MAP_PROBE_ROBIN_HOOD, .seed = 5};
+    int32_t result = staticMapSharedCreate(&shared_writer, writer_view, size, SHARED_ITEMS_IN_MAP, sizeof(myItem_t),
+                                           offsetof(myItem_t, node), true, &config);
+#if defined(STATIC_MAP_COMPACT_NODE) || defined(STATIC_MAP_UNORDERED)
+    if (result != STATIC_MAP_SUCCESS || staticMapSharedAttach(&shared_reader, reader_view, size, NULL) != STATIC_MAP_SUCCESS) {
+        printf("Test failed: Shared map create or attach\n");
+        return 1;
+    }
+
+    for (uint32_t key = 0; key < SHARED_KEYS; key++) {
+        insertDataItem(&shared_writer, key + 500, key * 7);
+    }
+    for (uint32_t key = 0; key < SHARED_KEYS; key += 3) {
+        staticMapRemoveByKey(&shared_writer, key * 7);
+    }
+
+    for (uint32_t key = 0; key < SHARED_KEYS; key++) {
+        staticMapItem_t *node;
+        uint32_t seq;
+        do {
+            seq  = staticMapReadBegin(&shared_reader);
+            node = staticMapFindConcurrent(&shared_reader, key * 7);
+        } while (staticMapReadRetry(&shared_reader, seq));
+
+        bool should_exist = (key % 3) != 0;
+        myItem_t *item = node != NULL ? CONTAINER_OF(node, myItem_t, node) : NULL;
+        if ((item != NULL) != should_exist || (item != NULL && item->data != key + 500) ||
+            (item != NULL && (uint8_t *)item < (uint8_t *)reader_view)) {
+            printf("Test failed: Shared lookup of %u\n", key * 7);
+            return 1;
+        }
+    }
+
+    if (staticMapGetNumItems(&shared_reader) != staticMapGetNumItems(&shared_writer)) {
+        printf("Test failed: Shared count differs\n");
+        return 1;
+    }
+
+    // A second writer takes over from the region alone
+    staticMap_t takeover = {0};
+    if (staticMapSharedDetach(&shared_writer) != STATIC_MAP_SUCCESS ||
+        staticMapSharedAttach(&takeover, reader_view, size, NULL) != STATIC_MAP_SUCCESS ||
+        staticMapRemoveByKey(&takeover, 7) != STATIC_MAP_SUCCESS || insertDataItem(&takeover, 1, 9999) == NULL ||
+        checkAllReachable(&takeover) != 0 || staticMapGetNumItems(&shared_reader) != staticMapGetNumItems(&takeover)) {
+        printf("Test failed: Shared map takeover\n");
+        return 1;
+    }
+
+    if (staticMapSharedDetach(&shared_reader) != STATIC_MAP_SUCCESS || staticMapSharedDetach(&shared_reader) != STATIC_MAP_INVALID_CONFIG) {
+        printf("Test failed: Shared map detach\n");
+        return 1;
+    }
+#else
+    // Pointer links can not be shared between address spaces
+    if (result != STATIC_MAP_INVALID_CONFIG ||
+        staticMapSharedAttach(&shared_reader, reader_view, size, NULL) != STATIC_MAP_INVALID_CONFIG) {
+        printf("Test failed: Shared map accepted in a pointer build\n");
+        return 1;
+    }
+#endif
+
+    munmap(writer_view, size);
+    munmap(reader_view, size);
+    fclose(file);
+    printf("Test passed: Process shared map\n");
+
+    return 0;
+}
+
+#define GROW_SMALL 16
+#define GROW_MEDIUM 40
+#define GROW_LARGE 128
+
+staticMap_t grow_map = {0};
+staticMapItem_t * grow_small_array[GROW_SMALL];
+myItem_t grow_small_items[GROW_SMALL];
+uint8_t grow_small_ctrl[STATIC_MAP_CTRL_BYTES(GROW_SMALL)];
+staticMapItem_t * grow_medium_array[GROW_MEDIUM];
+myItem_t grow_medium_items[GROW_MEDIUM];
+myItem_t grow_large_items[GROW_LARGE];
+uint8_t grow_large_ctrl[STATIC_MAP_CTRL_BYTES(GROW_LARGE)];
+static uint32_t grow_keys[GROW_LARGE];
+static uint32_t grow_num_keys = 0;
+
+static int growInsert(uint32_t key) {
+    if (insertDataItem(&grow_map, key + 7, key) == NULL) {
+        return 1;
+    }
+    grow_keys[grow_num_keys++] = key;
+    return 0;
+}
+
+#if !defined(STATIC_MAP_COMPACT_NODE) && !defined(STATIC_MAP_UNORDERED)
+// Every key with its data, oldest first
+static int checkGrowMap(void) {
+    uint32_t visited = 0;
+    staticMapIter_t iter;
+    STATIC_MAP_FOREACH(&grow_map, iter, node) {
+        myItem_t *item = CONTAINER_OF(node, myItem_t, node);
+        if (visited >= grow_num_keys || node->key != grow_keys[visited] || item->data != node->key + 7 ||
+            staticMapFind(&grow_map, node->key) != node) {
+            return 1;
+        }
+        visited++;
+    }
+
+    return visited != grow_num_keys || staticMapGetNumItems(&grow_map) != (int32_t)grow_num_keys;
+}
+
+static int growRemove(uint32_t position) {
+    if (staticMapRemoveByKey(&grow_map, grow_keys[position]) != STATIC_MAP_SUCCESS) {
+        return 1;
+    }
+    grow_num_keys--;
+    memmove(&grow_keys[position], &grow_keys[position + 1], (grow_num_keys - position) * sizeof(grow_keys[0]));
+    return 0;
+}
+#endif
+
+static int testGrow(void) {
+    staticMapConfig_t config = {.probe = STATIC_MAP_PROBE_ROBIN_HOOD, .ctrl = grow_small_ctrl,
+                                .node_offset = offsetof(myItem_t, node)};
+    staticMapInitWithConfig(&grow_map, grow_small_array, GROW_SMALL, sizeof(myItem_t), &grow_small_items[0].node, &config);
+
+    for (uint32_t key = 0; key < GROW_SMALL; key++) {
+        growInsert(key * 5);
+    }
+
+    int32_t result = staticMapGrowBegin(&grow_map, grow_medium_array, GROW_MEDIUM, &grow_medium_items[0].node, NULL);
+#if defined(STATIC_MAP_COMPACT_NODE) || defined(STATIC_MAP_UNORDERED)
+    if (result != STATIC_MAP_INVALID_CONFIG) {
+        printf("Test failed: Grow accepted in a build without pointer links\n");
+        return 1;
+    }
+#else
+    if (result != STATIC_MAP_SUCCESS || insertDataItem(&grow_map, 0, 5) != NULL ||
+        staticMapGrowBegin(&grow_map, NULL, GROW_LARGE, &grow_large_items[0].node, NULL) != STATIC_MAP_INVALID_CONFIG) {
+        printf("Test failed: Grow begin\n");
+        return 1;
+    }
+
+    // Keep using the map while it drains, every call moves a few slots
+    for (uint32_t key = GROW_SMALL; key < GROW_SMALL + 12; key++) {
+        if (growInsert(key * 5) != 0 || growRemove(key % 3) != 0 || checkGrowMap() != 0) {
+            printf("Test failed: Map changed during a grow\n");
+            return 1;
+        }
+    }
+
+    while ((result = staticMapGrowStep(&grow_map, 3)) > 0) {
+    }
+
+    if (result != 0 || grow_map.old.length != 0 || checkGrowMap() != 0 || checkAllReachable(&grow_map) != 0) {
+        printf("Test failed: Grow did not finish\n");
+        return 1;
+    }
+
+    // The old items are free again
+    for (uint32_t i = 0; i < GROW_SMALL; i++) {
+        if (staticMapItemState(&grow_small_items[i].node) == STATIC_MAP_SLOT_IN_USE) {
+            printf("Test failed: Grown map still uses the old items\n");
+            return 1;
+        }
+    }
+
+    // Grow again into a strided table with control bytes, driven by inserts alone
+    if (staticMapGrowBegin(&grow_map, NULL, GROW_LARGE, &grow_large_items[0].node, grow_large_ctrl) != STATIC_MAP_SUCCESS) {
+        printf("Test failed: Second grow begin\n");
+        return 1;
+    }
+
+    uint32_t key = 1000;
+    while (grow_map.old.length != 0) {
+        if (growInsert(key++) != 0 || checkGrowMap() != 0) {
+            printf("Test failed: Insert during the second grow\n");
+            return 1;
+        }
+    }
+
+    while (grow_num_keys < GROW_LARGE) {
+        growInsert(key++);
+    }
+
+    if (insertDataItem(&grow_map, 0, key) != NULL || checkGrowMap() != 0 || checkAllReachable(&grow_map) != 0) {
+        printf("Test failed: Full grown map\n");
+        return 1;
+    }
+#endif
+    printf("Test passed: Incremental grow\n");
+
+    return 0;
+}
+
+#define GROW_NODE_SMALL 8
+#define GROW_NODE_LARGE 16
+
+staticMap_t grow_node_map = {0};
+staticMapItem_t * grow_node_small_array[GROW_NODE_SMALL];
+myItem_t grow_node_small_items[GROW_NODE_SMALL];
+staticMapItem_t * grow_node_large_array[GROW_NODE_LARGE];
+myItem_t grow_node_large_items[GROW_NODE_LARGE];
+
+// The node is not first in myItem_t, STATIC_MAP_INIT must give the map its offset
+static int testGrowNodeNotFirst(void) {
+    // Without a config the map can not tell where the user structs start, copying them is refused
+    staticMapInit(&grow_node_map, grow_node_small_array, GROW_NODE_SMALL, sizeof(myItem_t), &grow_node_small_items[0].node);
+    insertDataItem(&grow_node_map, 100, 0);
+    if (staticMapSnapshot(&grow_node_map, snapshot_buffer, sizeof(snapshot_buffer)) != STATIC_MAP_INVALID_CONFIG ||
+        staticMapGrowBegin(&grow_node_map, grow_node_large_array, GROW_NODE_LARGE, &grow_node_large_items[0].node, NULL) != STATIC_MAP_INVALID_CONFIG) {
+        printf("Test failed: Map without a node offset was copied\n");
+        return 1;
+    }
+
+    if (offsetof(myItem_t, node) == 0 ||
+        STATIC_MAP_INIT(grow_node_map, grow_node_small_array, GROW_NODE_SMALL, grow_node_small_items) != STATIC_MAP_SUCCESS ||
+        grow_node_map.node_offset != offsetof(myItem_t, node)) {
+        printf("Test failed: Init did not set the node offset\n");
+        return 1;
+    }
+
+    for (uint32_t key = 0; key < GROW_NODE_SMALL; key++) {
+        insertDataItem(&grow_node_map, key + 100, key);
+    }
+
+    int32_t result = staticMapGrowBegin(&grow_node_map, grow_node_large_array, GROW_NODE_LARGE, &grow_node_large_items[0].node, NULL);
+#if defined(STATIC_MAP_COMPACT_NODE) || defined(STATIC_MAP_UNORDERED)
+    (void)result;
+#else
+    while (result >= 0 && (result = staticMapGrowStep(&grow_node_map, 2)) > 0) {
+    }
+
+    if (result != 0 || grow_node_map.old.length != 0) {
+        printf("Test failed: Grow with a node that is not first\n");
+        return 1;
+    }
+
+    for (uint32_t key = 0; key < GROW_NODE_SMALL; key++) {
+        myItem_t *item = findItem(&grow_node_map, key);
+        if (item == NULL || item < grow_node_large_items || item >= grow_node_large_items + GROW_NODE_LARGE ||
+            item->data != key + 100) {
+            printf("Test failed: Grow lost the data of %u\n", key);
+            return 1;
+        }
+    }
+#endif
+    printf("Test passed: Grow with the node after the data\n");
+
+    return 0;
+}
+
+#define FREEZE_ITEMS_IN_MAP 512
+#define FREEZE_KEYS 400
+
+staticMap_t freeze_map = {0};
+staticMapItem_t * freeze_array[FREEZE_ITEMS_IN_MAP];
+myItem_t freeze_item_map[FREEZE_ITEMS_IN_MAP];
+static uint32_t freeze_buffer[FREEZE_KEYS * 5];
+
+static uint32_t constantHash(uint32_t key, uint32_t seed) {
+    (void)key;
+    return seed;
+}
+
+static int testFreeze(void) {
+    staticMapConfig_t config = {.probe = STATIC_MAP_PROBE_ROBIN_HOOD, .seed = 3};
+    staticMapInitWithConfig(&freeze_map, freeze_array, FREEZE_ITEMS_IN_MAP, sizeof(myItem_t), &freeze_item_map[0].node, &config);
+
+    for (uint32_t key = 0; key < FREEZE_KEYS; key++) {
+        insertDataItem(&freeze_map, key + 1, key * 17);
+    }
+
+    size_t size = staticMapFreezeSize(&freeze_map);
+    if (size > sizeof(freeze_buffer) || staticMapFreeze(&freeze_map, freeze_buffer, size - 1) != STATIC_MAP_FULL ||
+        staticMapFreeze(&freeze_map, freeze_buffer, size) != STATIC_MAP_SUCCESS) {
+        printf("Test failed: Freeze\n");
+        return 1;
+    }
+
+    uint32_t keys[8];
+    staticMapItem_t *found[8];
+    for (uint32_t key = 0; key < FREEZE_KEYS * 17 + 20; key++) {
+        myItem_t *item = findItem(&freeze_map, key);
+        bool should_exist = key % 17 == 0 && key / 17 < FREEZE_KEYS;
+        if ((item != NULL) != should_exist || (item != NULL && item->data != key / 17 + 1)) {
+            printf("Test failed: Frozen lookup of %u\n", key);
+            return 1;
+        }
+        keys[key % 8] = key;
+        if (key % 8 == 7 && staticMapFindBatch(&freeze_map, keys, 8, found) != (found[0] != NULL) + (found[1] != NULL) +
+                (found[2] != NULL) + (found[3] != NULL) + (found[4] != NULL) + (found[5] != NULL) + (found[6] != NULL) + (found[7] != NULL)) {
+            printf("Test failed: Frozen batch lookup\n");
+            return 1;
+        }
+    }
+
+    // Read only until unfrozen
+    if (insertDataItem(&freeze_map, 0, 5) != NULL || staticMapRemoveByKey(&freeze_map, 17) != STATIC_MAP_FROZEN ||
+        staticMapRemove(&freeze_map, staticMapFind(&freeze_map, 17)) != STATIC_MAP_FROZEN ||
+        staticMapGetNumItems(&freeze_map) != FREEZE_KEYS) {
+        printf("Test failed: Frozen map accepted a change\n");
+        return 1;
+    }
+
+    if (staticMapUnfreeze(&freeze_map) != STATIC_MAP_SUCCESS || insertDataItem(&freeze_map, 0, 5) == NULL ||
+        staticMapRemoveByKey(&freeze_map, 17) != STATIC_MAP_SUCCESS || checkAllReachable(&freeze_map) != 0) {
+        printf("Test failed: Unfrozen map can not be changed\n");
+        return 1;
+    }
+
+    // Keys that share a hash value can not get a perfect hash
+    staticMapConfig_t weak = {.hash = constantHash};
+    staticMapInitWithConfig(&freeze_map, freeze_array, FREEZE_ITEMS_IN_MAP, sizeof(myItem_t), &freeze_item_map[0].node, &weak);
+    insertDataItem(&freeze_map, 1, 1);
+    insertDataItem(&freeze_map, 2, 2);
+    if (staticMapFreeze(&freeze_map, freeze_buffer, sizeof(freeze_buffer)) != STATIC_MAP_INVALID_KEY ||
+        insertDataItem(&freeze_map, 3, 3) == NULL) {
+        printf("Test failed: Freeze of colliding keys\n");
+        return 1;
+    }
+    printf("Test passed: Frozen map\n");
+
+    return 0;
+}
+
+#define BULK_KEYS 48
+
+static int checkBulkItems(staticMap_t *map, const uint32_t *keys, size_t n, staticMapItem_t **out) {
+    for (size_t i = 0; i < n; i++) {
+        if (out[i] != NULL && (out[i] != staticMapFind(map, keys[i]) || out[i]->key != keys[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int testBulkInsert(void) {
+    uint32_t keys[BULK_KEYS];
+    uint32_t scratch[2 * BULK_KEYS];
+    staticMapItem_t *out[BULK_KEYS];
+
+    // The last keys repeat earlier ones and must be skipped
+    for (uint32_t i = 0; i < BULK_KEYS; i++) {
+        keys[i] = (i < BULK_KEYS - 4 ? i : i - 20) * 11;
+    }
+
+    for (int variant = 0; variant < 5; variant++) {
+        staticMapConfig_t config = {0};
+        config.probe = (variant & 1) ? STATIC_MAP_PROBE_ROBIN_HOOD : STATIC_MAP_PROBE_LINEAR;
+        config.ctrl  = (variant & 2) ? strided_ctrl : NULL;
+        if (variant == 4) {
+            config.probe = STATIC_MAP_PROBE_CUCKOO;
+        }
+        STATIC_MAP_INIT_STRIDED(strided_map, STRIDED_ITEMS_IN_MAP, strided_item_map, node, &config);
+
+        int32_t result = staticMapBuildFrom(&strided_map, keys, BULK_KEYS, out, scratch);
+        if (result != BULK_KEYS - 4 || staticMapGetNumItems(&strided_map) != BULK_KEYS - 4 ||
+            out[BULK_KEYS - 1] != NULL || checkBulkItems(&strided_map, keys, BULK_KEYS, out) != 0 ||
+            checkAllReachable(&strided_map) != 0) {
+            printf("Test failed: Bulk build returned %i\n", result);
+            return 1;
+        }
+
+#ifndef STATIC_MAP_UNORDERED
+        // Linked in placement order, which is home bucket order for this map size
+        uint32_t listed = 0;
+        uint32_t last_home = 0;
+        bool sorted = true;
+        staticMapIter_t iter;
+        STATIC_MAP_FOREACH(&strided_map, iter, item) {
+            uint32_t home = staticMapHashMix32(item->key, 0) & (STRIDED_ITEMS_IN_MAP - 1);
+#ifndef STATIC_MAP_UNORDERED
+            sorted = sorted && home >= last_home;
+#endif
+            last_home = home;
+            listed++;
+        }
+
+        if (listed != BULK_KEYS - 4 || !sorted) {
+            printf("Test failed: Bulk build listed %u items\n", listed);
+            return 1;
+        }
+#endif
+
+        if (staticMapBuildFrom(&strided_map, keys, BULK_KEYS, out, scratch) != STATIC_MAP_INVALID_CONFIG) {
+            printf("Test failed: Bulk build into a non empty map\n");
+            return 1;
+        }
+
+        // Too many keys for the free slots, nothing may be inserted
+        if (staticMapBulkInsert(&strided_map, keys, STRIDED_ITEMS_IN_MAP - BULK_KEYS + 5, out, scratch) != STATIC_MAP_FULL ||
+            staticMapGetNumItems(&strided_map) != BULK_KEYS - 4) {
+            printf("Test failed: Bulk insert overfilled the map\n");
+            return 1;
+        }
+
+        // One key already in the map and three new ones
+        uint32_t more[4] = {11, 1001, 1002, 1003};
+        result = staticMapBulkInsert(&strided_map, more, 4, out, scratch);
+        if (result != 3 || out[0] != NULL || checkBulkItems(&strided_map, more, 4, out) != 0 ||
+            staticMapGetNumItems(&strided_map) != BULK_KEYS - 1 || checkAllReachable(&strided_map) != 0) {
+            printf("Test failed: Bulk insert into a filled map returned %i\n", result);
+            return 1;
+        }
+    }
+
+    // Every key has the same two buckets, the rest does not fit and is reported as not placed
+    staticMapConfig_t crowded = {.probe = STATIC_MAP_PROBE_CUCKOO, .hash = constantHash};
+    STATIC_MAP_INIT_STRIDED(strided_map, STRIDED_ITEMS_IN_MAP, strided_item_map, node, &crowded);
+    int32_t result = staticMapBuildFrom(&strided_map, keys, BULK_KEYS - 4, out, scratch);
+    int32_t placed = 0;
+    for (uint32_t i = 0; i < BULK_KEYS - 4; i++) {
+        placed += out[i] != NULL;
+    }
+
+    if (result != STATIC_MAP_FULL || placed == 0 || placed != staticMapGetNumItems(&strided_map) ||
+        checkBulkItems(&strided_map, keys, BULK_KEYS - 4, out) != 0) {
+        printf("Test failed: Bulk insert into a crowded cuckoo map returned %i\n", result);
+        return 1;
+    }
+
+    STATIC_MAP_INIT_STRIDED(strided_map, STRIDED_ITEMS_IN_MAP, strided_item_map, node, NULL);
+    staticMapBuildFrom(&strided_map, keys, BULK_KEYS, out, scratch);
+    if (staticMapFreeze(&strided_map, freeze_buffer, sizeof(freeze_buffer)) != STATIC_MAP_SUCCESS ||
+        staticMapBulkInsert(&strided_map, keys, 1, out, scratch) != STATIC_MAP_FROZEN) {
+        printf("Test failed: Bulk insert into a frozen map\n");
+        return 1;
+    }
+    printf("Test passed: Bulk insert\n");
+
+    return 0;
+}
+
+#define SHARDS 4
+#define SHARD_ITEMS 64
+#define SHARDED_KEYS 160
+
+static staticShardedMap_t sharded_map;
+static staticShardedMapShard_t sharded_shards[SHARDS];
+staticMapItem_t * sharded_array[SHARDS][SHARD_ITEMS];
+myItem_t sharded_item_map[SHARDS][SHARD_ITEMS];
+static uint32_t sharded_visited = 0;
+
+static int32_t shardedVisitCb(staticMap_t *map, staticMapItem_t *item) {
+    (void)map;
+    sharded_visited++;
+    return item->key % 2 == 0 ? STATIC_MAP_CB_ERASE : STATIC_MAP_CB_NEXT;
+}
+
+static int32_t shardedStopCb(staticMap_t *map, staticMapItem_t *item) {
+    (void)map;
+    (void)item;
+    sharded_visited++;
+    return STATIC_MAP_CB_STOP;
+}
+
+static int testShardedMap(void) {
+    if (sizeof(staticShardedMapShard_t) % STATIC_SHARDED_MAP_CACHE_LINE != 0 ||
+        staticShardedMapInit(&sharded_map, (staticShardedMapShard_t *)((uint8_t *)sharded_shards + 8), SHARDS, NULL, 0) != STATIC_MAP_INVALID_CONFIG ||
+        staticShardedMapInit(&sharded_map, sharded_shards, 0, NULL, 0) != STATIC_MAP_INVALID_CONFIG ||
+        staticShardedMapInit(&sharded_map, sharded_shards, SHARDS, NULL, 7) != STATIC_MAP_SUCCESS) {
+        printf("Test failed: Sharded map init\n");
+        return 1;
+    }
+
+    // Shards without storage hold nothing
+    if (staticShardedMapInsertAndGet(&sharded_map, 1) != NULL || staticShardedMapGetNumItems(&sharded_map) != 0) {
+        printf("Test failed: Uninitialized shard accepted a key\n");
+        return 1;
+    }
+
+    for (uint32_t shard = 0; shard < SHARDS; shard++) {
+        if (staticShardedMapInitShard(&sharded_map, shard, sharded_array[shard], SHARD_ITEMS, sizeof(myItem_t),
+                                      &sharded_item_map[shard][0].node, NULL) != STATIC_MAP_SUCCESS) {
+            printf("Test failed: Shard %u init\n", shard);
+            return 1;
+        }
+    }
+
+    if (staticShardedMapInitShard(&sharded_map, SHARDS, sharded_array[0], SHARD_ITEMS, sizeof(myItem_t),
+                                  &sharded_item_map[0][0].node, NULL) != STATIC_MAP_INVALID_CONFIG ||
+        staticShardedMapShard(&sharded_map, SHARDS) != NULL) {
+        printf("Test failed: Shard index out of range\n");
+        return 1;
+    }
+
+    for (uint32_t key = 0; key < SHARDED_KEYS; key++) {
+        staticMapItem_t *item = staticShardedMapInsertAndGet(&sharded_map, key);
+        uint32_t shard = staticShardedMapShardOf(&sharded_map, key);
+        myItem_t *owner_items = sharded_item_map[shard];
+
+        // The item must come from the storage of the owning shard
+        if (item == NULL || CONTAINER_OF(item, myItem_t, node) < owner_items ||
+            CONTAINER_OF(item, myItem_t, node) >= owner_items + SHARD_ITEMS ||
+            staticShardedMapRoute(&sharded_map, key) != staticShardedMapShard(&sharded_map, shard)) {
+            printf("Test failed: Sharded insert of %u\n", key);
+            return 1;
+        }
+    }
+
+    int32_t per_shard = 0;
+    for (uint32_t shard = 0; shard < SHARDS; shard++) {
+        int32_t count = staticMapGetNumItems(staticShardedMapShard(&sharded_map, shard));
+        if (count == 0) {
+            printf("Test failed: Shard %u got no keys\n", shard);
+            return 1;
+        }
+        per_shard += count;
+    }
+
+    if (per_shard != SHARDED_KEYS || staticShardedMapGetNumItems(&sharded_map) != SHARDED_KEYS ||
+        staticShardedMapInsertAndGet(&sharded_map, 5) != NULL) {
+        printf("Test failed: Sharded count %i\n", per_shard);
+        return 1;
+    }
+
+    // Erase the even keys in every shard
+    if (staticShardedMapForEach(&sharded_map, shardedVisitCb) != STATIC_MAP_SUCCESS || sharded_visited != SHARDED_KEYS ||
+        staticShardedMapGetNumItems(&sharded_map) != SHARDED_KEYS / 2) {
+        printf("Test failed: Sharded for each visited %u\n", sharded_visited);
+        return 1;
+    }
+
+    for (uint32_t key = 0; key < SHARDED_KEYS; key++) {
+        staticMapItem_t *item = staticShardedMapFind(&sharded_map, key);
+        if ((item != NULL) != (key % 2 == 1)) {
+            printf("Test failed: Sharded find of %u\n", key);
+            return 1;
+        }
+    }
+
+    sharded_visited = 0;
+    if (staticShardedMapForEach(&sharded_map, shardedStopCb) != STATIC_MAP_SUCCESS || sharded_visited != 1 ||
+        staticShardedMapRemoveByKey(&sharded_map, 3) != STATIC_MAP_SUCCESS ||
+        staticShardedMapRemoveByKey(&sharded_map, 3) != STATIC_MAP_UNUSED_ERASE ||
+        staticShardedMapGetNumItems(&sharded_map) != SHARDED_KEYS / 2 - 1) {
+        printf("Test failed: Sharded stop and remove\n");
+        return 1;
+    }
+    printf("Test passed: Sharded map\n");
+
+    return 0;
+}
+
+#define UPSERT_ITEMS_IN_MAP 16
+
+staticMap_t upsert_map = {0};
+staticMapItem_t * upsert_array[UPSERT_ITEMS_IN_MAP];
+myItem_t upsert_item_map[UPSERT_ITEMS_IN_MAP];
+uint8_t upsert_ctrl[STATIC_MAP_CTRL_BYTES(UPSERT_ITEMS_IN_MAP)];
+
+static uint32_t upsert_freeze_buffer[UPSERT_ITEMS_IN_MAP * 8];
+
+static int testFindOrInsert(void) {
+    for (int variant = 0; variant < 3; variant++) {
+        staticMapConfig_t config = {0};
+        config.probe = variant == 1 ? STATIC_MAP_PROBE_ROBIN_HOOD : STATIC_MAP_PROBE_LINEAR;
+        config.ctrl  = variant == 2 ? upsert_ctrl : NULL;
+        staticMapInitWithConfig(&upsert_map, upsert_array, UPSERT_ITEMS_IN_MAP, sizeof(myItem_t), &upsert_item_map[0].node, &config);
+
+        staticMapItem_t *item = NULL;
+        for (uint32_t key = 0; key < UPSERT_ITEMS_IN_MAP; key++) {
+            if (staticMapFindOrInsert(&upsert_map, key * 7, &item) != 1 || item == NULL || item->key != key * 7) {
+                printf("Test failed: Find or insert of new key %u\n", key * 7);
+                return 1;
+            }
+        }
+
+        // A full map still returns the keys it holds, new keys fail with STATIC_MAP_FULL
+        for (uint32_t key = 0; key < UPSERT_ITEMS_IN_MAP; key++) {
+            if (staticMapFindOrInsert(&upsert_map, key * 7, &item) != 0 || item == NULL ||
+                item != staticMapFind(&upsert_map, key * 7)) {
+                printf("Test failed: Find or insert of existing key %u\n", key * 7);
+                return 1;
+            }
+        }
+
+        if (staticMapFindOrInsert(&upsert_map, 1, &item) != STATIC_MAP_FULL || item != NULL ||
+            staticMapGetNumItems(&upsert_map) != UPSERT_ITEMS_IN_MAP) {
+            printf("Test failed: Find or insert into a full map\n");
+            return 1;
+        }
+    }
+
+    // A frozen map finds its keys and refuses new ones as frozen, not as full
+    staticMapInitWithConfig(&upsert_map, upsert_array, UPSERT_ITEMS_IN_MAP, sizeof(myItem_t), &upsert_item_map[0].node, NULL);
+    staticMapItem_t *item = NULL;
+    staticMapFindOrInsert(&upsert_map, 5, &item);
+    if (staticMapFreezeSize(&upsert_map) > sizeof(upsert_freeze_buffer) ||
+        staticMapFreeze(&upsert_map, upsert_freeze_buffer, sizeof(upsert_freeze_buffer)) != STATIC_MAP_SUCCESS ||
+        staticMapFindOrInsert(&upsert_map, 5, &item) != 0 || item == NULL ||
+        staticMapFindOrInsert(&upsert_map, 6, &item) != STATIC_MAP_FROZEN || item != NULL) {
+        printf("Test failed: Find or insert into a frozen map\n");
+        return 1;
+    }
+    staticMapUnfreeze(&upsert_map);
+
+#ifdef STATIC_MAP_UNORDERED
+    // Erasing and breaking leaves a tombstone in slot 0, keys 0, 16 and 32 share home bucket 0
+    staticMapConfig_t identity = {.hash = staticMapHashIdentity};
+    staticMapInitWithConfig(&upsert_map, upsert_array, UPSERT_ITEMS_IN_MAP, sizeof(myItem_t), &upsert_item_map[0].node, &identity);
+    staticMapFindOrInsert(&upsert_map, 0, &item);
+    staticMapFindOrInsert(&upsert_map, 16, &item);
+    staticMapFindOrInsert(&upsert_map, 32, &item);
+
+    staticMapIter_t iter;
+    STATIC_MAP_FOREACH(&upsert_map, iter, erased) {
+        (void)erased;
+        staticMapIterErase(&iter);
+        break;
+    }
+
+    // The key past the tombstone is found, a new key takes the tombstone
+    if (staticMapFindOrInsert(&upsert_map, 32, &item) != 0 || item == NULL ||
+        countSlotsInState(&upsert_map, STATIC_MAP_SLOT_DELETED) != 1) {
+        printf("Test failed: Find or insert past a tombstone\n");
+        return 1;
+    }
+
+    if (staticMapFindOrInsert(&upsert_map, 48, &item) != 1 || item == NULL || staticMapSlotItem(&upsert_map, 0) != item ||
+        countSlotsInState(&upsert_map, STATIC_MAP_SLOT_DELETED) != 0 || staticMapGetNumItems(&upsert_map) != 3) {
+        printf("Test failed: Find or insert did not reuse the tombstone\n");
+        return 1;
+    }
+#endif
+    printf("Test passed: Find or insert\n");
+
+    return 0;
+}
+
+#define HASHED_ITEMS_IN_MAP 128
+#define HASHED_KEYS 100
+
+staticMap_t hashed_map = {0};
+staticMapItem_t * hashed_array[HASHED_ITEMS_IN_MAP];
+myItem_t hashed_item_map[HASHED_ITEMS_IN_MAP];
+uint8_t hashed_ctrl[STATIC_MAP_CTRL_BYTES(HASHED_ITEMS_IN_MAP)];
+static uint32_t hashed_buffer[HASHED_KEYS * 5];
+
+// A hash from an earlier stage. Stored hashes let it differ from the map hash
+static uint32_t callerHash(uint32_t key) {
+#ifdef STATIC_MAP_STORED_HASH
+    return staticMapHashFibonacci(key, 99);
+#else
+    return staticMapHashMix32(key, 0);
+#endif
+}
+
+static int testHashedCalls(void) {
+    for (int variant = 0; variant < 4; variant++) {
+        staticMapConfig_t config = {0};
+        config.probe      = variant == 1 ? STATIC_MAP_PROBE_ROBIN_HOOD : STATIC_MAP_PROBE_LINEAR;
+        config.ctrl       = variant == 2 ? hashed_ctrl : NULL;
+        config.concurrent = variant == 3;
+        staticMapInitWithConfig(&hashed_map, hashed_array, HASHED_ITEMS_IN_MAP, sizeof(myItem_t), &hashed_item_map[0].node, &config);
+
+        for (uint32_t key = 0; key < HASHED_KEYS; key++) {
+            staticMapItem_t *item = staticMapInsertAndGetHashed(&hashed_map, key * 3, callerHash(key * 3));
+            if (item == NULL || staticMapInsertAndGetHashed(&hashed_map, key * 3, callerHash(key * 3)) != NULL) {
+                printf("Test failed: Hashed insert of %u\n", key * 3);
+                return 1;
+            }
+#ifdef STATIC_MAP_STORED_HASH
+            if (item->hash != callerHash(key * 3)) {
+                printf("Test failed: Hash of %u not stored\n", key * 3);
+                return 1;
+            }
+#endif
+        }
+
+        // Removes shift the clusters back, the moved entries must still be found by their hash
+        for (uint32_t key = 0; key < HASHED_KEYS; key += 2) {
+            if (staticMapRemoveByKeyHashed(&hashed_map, key * 3, callerHash(key * 3)) != STATIC_MAP_SUCCESS) {
+                printf("Test failed: Hashed remove of %u\n", key * 3);
+                return 1;
+            }
+        }
+
+        for (uint32_t key = 0; key < HASHED_KEYS; key++) {
+            staticMapItem_t *item = staticMapFindHashed(&hashed_map, key * 3, callerHash(key * 3));
+            staticMapItem_t *found = NULL;
+            if ((item != NULL) != (key % 2 == 1) || (item != NULL && item->key != key * 3) ||
+                staticMapFindOrInsertHashed(&hashed_map, key * 3, callerHash(key * 3), &found) != (key % 2 == 0 ? 1 : 0) ||
+                found == NULL) {
+                printf("Test failed: Hashed find of %u\n", key * 3);
+                return 1;
+            }
+        }
+
+        // Readers have to probe from the same hash the writer inserted with
+        for (uint32_t key = 0; key < HASHED_KEYS; key++) {
+            staticMapItem_t *item;
+            uint32_t seq;
+            do {
+                seq  = staticMapReadBegin(&hashed_map);
+                item = staticMapFindConcurrentHashed(&hashed_map, key * 3, callerHash(key * 3));
+            } while (staticMapReadRetry(&hashed_map, seq));
+
+            if (item == NULL || item->key != key * 3) {
+                printf("Test failed: Concurrent hashed find of %u\n", key * 3);
+                return 1;
+            }
+        }
+
+        // The perfect hash is built from the same hashes
+        if (staticMapFreeze(&hashed_map, hashed_buffer, sizeof(hashed_buffer)) != STATIC_MAP_SUCCESS) {
+            printf("Test failed: Hashed freeze\n");
+            return 1;
+        }
+
+        for (uint32_t key = 0; key < HASHED_KEYS; key++) {
+            if (staticMapFindHashed(&hashed_map, key * 3, callerHash(key * 3)) == NULL) {
+                printf("Test failed: Frozen hashed find of %u\n", key * 3);
+                return 1;
+            }
+        }
+        staticMapUnfreeze(&hashed_map);
+    }
+    printf("Test passed: Hashed calls\n");
+
+    return 0;
+}
+
+#define CUCKOO_ITEMS_IN_MAP 64
+
+staticMap_t cuckoo_map = {0};
+staticMapItem_t * cuckoo_array[CUCKOO_ITEMS_IN_MAP];
+myItem_t cuckoo_item_map[CUCKOO_ITEMS_IN_MAP];
+uint8_t cuckoo_ctrl[STATIC_MAP_CTRL_BYTES(CUCKOO_ITEMS_IN_MAP)];
+
+static int32_t cuckooEraseOddCb(staticMap_t *map, staticMapItem_t *item) {
+    (void)map;
+    return item->key % 2 == 1 ? STATIC_MAP_CB_ERASE : STATIC_MAP_CB_NEXT;
+}
+
+static int testCuckoo(void) {
+    staticMapConfig_t config = {.probe = STATIC_MAP_PROBE_CUCKOO};
+    staticMapConfig_t with_ctrl = {.probe = STATIC_MAP_PROBE_CUCKOO, .ctrl = cuckoo_ctrl};
+    staticMapConfig_t concurrent = {.probe = STATIC_MAP_PROBE_CUCKOO, .concurrent = true};
+
+    if (staticMapInitWithConfig(&cuckoo_map, cuckoo_array, 8, sizeof(myItem_t), &cuckoo_item_map[0].node, &config) != STATIC_MAP_INVALID_CONFIG ||
+        staticMapInitWithConfig(&cuckoo_map, cuckoo_array, CUCKOO_ITEMS_IN_MAP, sizeof(myItem_t), &cuckoo_item_map[0].node, &with_ctrl) != STATIC_MAP_INVALID_CONFIG ||
+        staticMapInitWithConfig(&cuckoo_map, cuckoo_array, CUCKOO_ITEMS_IN_MAP, sizeof(myItem_t), &cuckoo_item_map[0].node, &concurrent) != STATIC_MAP_INVALID_CONFIG) {
+        printf("Test failed: Cuckoo map accepted an invalid config\n");
+        return 1;
+    }
+
+    for (int strided = 0; strided < 2; strided++) {
+        if (strided) {
+            STATIC_MAP_INIT_STRIDED(cuckoo_map, CUCKOO_ITEMS_IN_MAP, cuckoo_item_map, node, &config);
+        } else {
+            staticMapInitWithConfig(&cuckoo_map, cuckoo_array, CUCKOO_ITEMS_IN_MAP, sizeof(myItem_t), &cuckoo_item_map[0].node, &config);
+        }
+
+        // Fill until the first insert fails, both buckets and the stash are full by then
+        uint32_t inserted = 0;
+        while (inserted < CUCKOO_ITEMS_IN_MAP && insertDataItem(&cuckoo_map, (inserted * 3 + 1) * 3, inserted * 3 + 1) != NULL) {
+            inserted++;
+        }
+
+        if (inserted < CUCKOO_ITEMS_IN_MAP * 8 / 10 || checkAllReachable(&cuckoo_map) != 0 ||
+            checkStridedPayload(&cuckoo_map) != 0 || staticMapGetNumItems(&cuckoo_map) != (int32_t)inserted) {
+            printf("Test failed: Cuckoo map held %u items\n", inserted);
+            return 1;
+        }
+
+        // Every lookup reads at most the two buckets and the stash
+        staticMapStats_t stats;
+        staticMapGetStats(&cuckoo_map, &stats);
+        if (stats.max_probe_distance > 2 || staticMapGrowBegin(&cuckoo_map, cuckoo_array, CUCKOO_ITEMS_IN_MAP * 2,
+                                                               &cuckoo_item_map[0].node, NULL) != STATIC_MAP_INVALID_CONFIG) {
+            printf("Test failed: Cuckoo probe distance %u\n", stats.max_probe_distance);
+            return 1;
+        }
+
+        uint32_t keys[CUCKOO_ITEMS_IN_MAP];
+        for (uint32_t i = 0; i < CUCKOO_ITEMS_IN_MAP; i++) {
+            keys[i] = i * 3 + 1 + (i % 4 == 0 ? 1 : 0);
+        }
+
+        if (checkFindBatch(&cuckoo_map, keys, CUCKOO_ITEMS_IN_MAP) != 0) {
+            printf("Test failed: Cuckoo batch find\n");
+            return 1;
+        }
+
+#ifndef STATIC_MAP_UNORDERED
+        // Relocations keep the insertion order
+        uint32_t previous_key = 0;
+        staticMapIter_t iter;
+        STATIC_MAP_FOREACH(&cuckoo_map, iter, item) {
+            if (item->key <= previous_key) {
+                printf("Test failed: Cuckoo list out of order\n");
+                return 1;
+            }
+            previous_key = item->key;
+        }
+#endif
+
+        // Keys 1, 7, 13 ... are odd, 4, 10, 16 ... are even
+        if (staticMapForEach(&cuckoo_map, cuckooEraseOddCb) != STATIC_MAP_SUCCESS || checkAllReachable(&cuckoo_map) != 0 ||
+            staticMapGetNumItems(&cuckoo_map) != (int32_t)(inserted / 2)) {
+            printf("Test failed: Cuckoo erase\n");
+            return 1;
+        }
+
+        for (uint32_t i = 0; i < inserted; i++) {
+            uint32_t key = i * 3 + 1;
+            myItem_t *item = findItem(&cuckoo_map, key);
+            if ((item != NULL) != (key % 2 == 0) || (item != NULL && item->data != key * 3)) {
+                printf("Test failed: Cuckoo find of %u after erase\n", key);
+                return 1;
+            }
+        }
+
+        // The freed slots take new keys
+        for (uint32_t i = 0; i < inserted / 2; i++) {
+            if (insertDataItem(&cuckoo_map, (1000 + i) * 3, 1000 + i) == NULL || checkStridedPayload(&cuckoo_map) != 0) {
+                printf("Test failed: Cuckoo reinsert of %u\n", 1000 + i);
+                return 1;
+            }
+        }
+    }
+    printf("Test passed: Cuckoo map\n");
+
+    return 0;
+}
+
+#define DENSE_ITEMS 48
+#define DENSE_INDEX 96
+
+typedef struct {
+    uint32_t data;
+    staticDenseMapItem_t node;
+} myDenseItem_t;
+
+static staticDenseMap_t dense_map;
+static uint32_t dense_index[DENSE_INDEX];
+static myDenseItem_t dense_items[DENSE_ITEMS];
+static uint32_t dense_visited = 0;
+
+static int32_t denseEraseCb(staticDenseMap_t *map, staticDenseMapItem_t *item) {
+    (void)map;
+    dense_visited++;
+    return item->key % 3 == 0 ? STATIC_MAP_CB_ERASE : STATIC_MAP_CB_NEXT;
+}
+
+// Every live item must sit in the front of the pool and be reachable through the index
+static int denseMapConsistent(staticDenseMap_t *map) {
+    int32_t count = staticDenseMapGetNumItems(map);
+    for (int32_t position = 0; position < count; position++) {
+        staticDenseMapItem_t *item = staticDenseMapItemAt(map, (uint32_t)position);
+        myDenseItem_t *dense = CONTAINER_OF(item, myDenseItem_t, node);
+        if (staticDenseMapFind(map, item->key) != item || dense->data != item->key * 3) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int testDenseMap(void) {
+    staticMapConfig_t cuckoo = { .probe = STATIC_MAP_PROBE_CUCKOO };
+
+    if (STATIC_DENSE_MAP_INIT(dense_map, dense_index, DENSE_ITEMS, dense_items, DENSE_ITEMS, node, NULL) != STATIC_MAP_INVALID_CONFIG ||
+        STATIC_DENSE_MAP_INIT(dense_map, dense_index, DENSE_INDEX, dense_items, DENSE_ITEMS, node, &cuckoo) != STATIC_MAP_INVALID_CONFIG ||
+        STATIC_DENSE_MAP_INIT(dense_map, dense_index, DENSE_INDEX, dense_items, DENSE_ITEMS, node, NULL) != STATIC_MAP_SUCCESS) {
+        printf("Test failed: Dense map init\n");
+        return 1;
+    }
+
+    // Fill the pool, the items are handed out in pool order
+    for (uint32_t key = 0; key < DENSE_ITEMS; key++) {
+        staticDenseMapItem_t *item = staticDenseMapInsertAndGet(&dense_map, key * 7);
+        if (item != &dense_items[key].node) {
+            printf("Test failed: Dense insert of %u\n", key * 7);
+            return 1;
+        }
+        dense_items[key].data = key * 21;
+    }
+
+    if (staticDenseMapInsertAndGet(&dense_map, 1) != NULL || staticDenseMapInsertAndGet(&dense_map, 7) != NULL ||
+        staticDenseMapGetNumItems(&dense_map) != DENSE_ITEMS || denseMapConsistent(&dense_map) != 0) {
+        printf("Test failed: Dense map full or duplicate\n");
+        return 1;
+    }
+
+    // Removing the first item moves the last one into its place
+    staticDenseMapItem_t *first = staticDenseMapFind(&dense_map, 0);
+    if (staticDenseMapRemove(&dense_map, first) != STATIC_MAP_SUCCESS || first->key != (DENSE_ITEMS - 1) * 7 ||
+        dense_items[0].data != (DENSE_ITEMS - 1) * 21 ||
+        staticDenseMapFind(&dense_map, 0) != NULL || staticDenseMapFind(&dense_map, (DENSE_ITEMS - 1) * 7) != first) {
+        printf("Test failed: Dense remove did not move the last item\n");
+        return 1;
+    }
+
+    if (staticDenseMapRemove(&dense_map, &dense_items[DENSE_ITEMS - 1].node) != STATIC_MAP_UNUSED_ERASE ||
+        staticDenseMapRemove(&dense_map, (staticDenseMapItem_t *)((uint8_t *)first + 1)) != STATIC_MAP_INVALID_KEY ||
+        staticDenseMapRemoveByKey(&dense_map, 0) != STATIC_MAP_UNUSED_ERASE ||
+        staticDenseMapRemoveByKey(&dense_map, 14) != STATIC_MAP_SUCCESS ||
+        staticDenseMapGetNumItems(&dense_map) != DENSE_ITEMS - 2 || denseMapConsistent(&dense_map) != 0) {
+        printf("Test failed: Dense remove\n");
+        return 1;
+    }
+
+    // Erase every key divisible by 3, the walk covers exactly the live items
+    int32_t before = staticDenseMapGetNumItems(&dense_map);
+    int32_t erased = 0;
+    for (int32_t position = 0; position < before; position++) {
+        erased += staticDenseMapItemAt(&dense_map, (uint32_t)position)->key % 3 == 0;
+    }
+
+    if (staticDenseMapForEach(&dense_map, denseEraseCb) != STATIC_MAP_SUCCESS || dense_visited != (uint32_t)before ||
+        staticDenseMapGetNumItems(&dense_map) != before - erased || denseMapConsistent(&dense_map) != 0) {
+        printf("Test failed: Dense for each visited %u\n", dense_visited);
+        return 1;
+    }
+
+    for (uint32_t key = 0; key < DENSE_ITEMS; key++) {
+        bool live = key != 0 && key != 2 && (key * 7) % 3 != 0;
+        if ((staticDenseMapFind(&dense_map, key * 7) != NULL) != live) {
+            printf("Test failed: Dense find of %u\n", key * 7);
+            return 1;
+        }
+    }
+
+    // Refill, new items come from the end of the live range
+    int32_t count = staticDenseMapGetNumItems(&dense_map);
+    staticDenseMapItem_t *item = staticDenseMapInsertAndGet(&dense_map, 1000);
+    if (item != &dense_items[count].node || staticDenseMapFind(&dense_map, 1000) != item) {
+        printf("Test failed: Dense insert after remove\n");
+        return 1;
+    }
+
+    printf("Test passed: Dense map\n");
+    return 0;
+}
+
 int main(void) {
     int32_t result = STATIC_MAP_INIT(my_map, map_array, NUM_ITEMS_IN_MAP, my_item_map);
     printf("Static Map inti result %i\n", result);
@@ -308,6 +2554,116 @@ int main(void) {
     }
     printf("Test passed: Map has 0 item remaining\n");
 
+    if (testRemoveLeavesNoTombstones() != 0) {
+        return 1;
+    }
+
+    if (testRobinHood() != 0) {
+        return 1;
+    }
+
+    if (testStats() != 0) {
+        return 1;
+    }
+
+    if (testHashConfig() != 0) {
+        return 1;
+    }
+
+    if (testControlBytes() != 0) {
+        return 1;
+    }
+
+    if (testBatch() != 0) {
+        return 1;
+    }
+
+#ifndef STATIC_MAP_UNORDERED
+    if (testLru() != 0) {
+        return 1;
+    }
+#endif
+
+#ifdef STATIC_MAP_TTL
+    if (testExpire() != 0) {
+        return 1;
+    }
+#endif
+
+    if (testConcurrentReaders() != 0) {
+        return 1;
+    }
+
+    if (testTypedMap() != 0) {
+        return 1;
+    }
+
+    if (testIterator() != 0) {
+        return 1;
+    }
+
+    if (testStrided() != 0) {
+        return 1;
+    }
+
+    if (testSnapshot() != 0) {
+        return 1;
+    }
+
+    if (testSnapshotPayload() != 0) {
+        return 1;
+    }
+
+    if (testSnapshotReload() != 0) {
+        return 1;
+    }
+
+    if (testSharedMap() != 0) {
+        return 1;
+    }
+
+    if (testGrow() != 0) {
+        return 1;
+    }
+
+    if (testGrowNodeNotFirst() != 0) {
+        return 1;
+    }
+
+    if (testFreeze() != 0) {
+        return 1;
+    }
+
+    if (testBulkInsert() != 0) {
+        return 1;
+    }
+
+    if (testShardedMap() != 0) {
+        return 1;
+    }
+
+    if (testFindOrInsert() != 0) {
+        return 1;
+    }
+
+    if (testHashedCalls() != 0) {
+        return 1;
+    }
+
+    if (testCuckoo() != 0) {
+        return 1;
+    }
+
+    if (testDenseMap() != 0) {
+        return 1;
+    }
+
+#if defined(STATIC_MAP_COMPACT_NODE) && !defined(STATIC_MAP_UNORDERED) && !defined(STATIC_MAP_TTL) && !defined(STATIC_MAP_STORED_HASH)
+    if (testCompactNode() != 0) {
+        return 1;
+    }
+#endif
+
     printf("\nAll tests passed!\n");
     return result;
 }
\ No newline at end of file